@@ -6,18 +6,270 @@
 #include "string.h"
 #include "stdlib.h"
 
+//audio sample rate in Hz, 16000, 20000, 32000 and 40000 all work
+//the timer, low frequency decimation, bucket maps and Hz conversion all follow from this
+#ifndef AUDIO_SAMPLE_RATE
+#define AUDIO_SAMPLE_RATE 20000
+#endif
+//the low frequency buffer is always decimated down to this
+#define LOW_SAMPLE_RATE 400
+#define LOW_DECIMATION (AUDIO_SAMPLE_RATE / LOW_SAMPLE_RATE)
+
 #define HIGH_N 512
 #define HIGH_NLOG2 9
 
 #define LOW_N 32
 #define LOW_NLOG2 5
 
+//window shapes, x is the phase from 0 to 2*pi across the fft
+//numbers are for the Q15 tables, sidelobe is the highest sidelobe, scalloping is the loss halfway between bins
+//and coherent gain is on top of the 1/2 applied when windowing, tools/window_check.c measures them on the compiled tables
+//pick one per band in LOW_WINDOW and HIGH_WINDOW
+//sine: -23dB sidelobe, -2.1dB scalloping, 0.64 coherent gain, 1.23 bin noise bandwidth. narrowest, the original window
+#define WINDOW_SINE(x) __builtin_sin((x) / 2)
+//hann: -31.5dB sidelobe, -1.4dB scalloping, 0.50 coherent gain, 1.50 bin noise bandwidth
+#define WINDOW_HANN(x) (0.5 - 0.5 * __builtin_cos(x))
+//4 term blackman-harris: -92dB sidelobe (-90dB at 32 points), -0.8dB scalloping, 0.36 coherent gain, 2.00 bin noise bandwidth
+#define WINDOW_BLACKMAN_HARRIS(x) (0.35875 - 0.48829 * __builtin_cos(x) + 0.14128 * __builtin_cos(2 * (x)) \
+		- 0.01168 * __builtin_cos(3 * (x)))
+//flat-top: -92dB sidelobe (-82dB at 32 points), -0.01dB scalloping, 0.22 coherent gain, 3.77 bin noise bandwidth
+//accurate levels no matter where a tone lands, but wide
+#define WINDOW_FLATTOP(x) (0.21557895 - 0.41663158 * __builtin_cos(x) + 0.277263158 * __builtin_cos(2 * (x)) \
+		- 0.083578947 * __builtin_cos(3 * (x)) + 0.006947368 * __builtin_cos(4 * (x)))
+
+#ifndef LOW_WINDOW
+#define LOW_WINDOW WINDOW_SINE
+#endif
+#ifndef HIGH_WINDOW
+#define HIGH_WINDOW WINDOW_SINE
+#endif
+
+//corner of the high pass that removes dc from the audio ahead of the ffts, see dcBlock()
+//at 10Hz: -0.3dB at 37Hz, and a step settles to within 1% in 73ms. tools/dc_block_check.c measures them on dcBlock() itself
+#ifndef DC_BLOCK_CORNER_HZ
+#define DC_BLOCK_CORNER_HZ 10
+#endif
+
+//the fft treats the real input as a half size complex signal, so sample i of an
+//n = 1<<nlog2 buffer is stored with the evens in the first half and the odds in the second
+#define FFT_SLOT(i, nlog2) (((i) >> 1) | (((i) & 1) << ((nlog2) - 1)))
+
+//log2 of a full period of fixSin()
+#define N_WAVE_LOG2 10
+
+//define to keep track of how many cycles the ffts take, see fftCycles
+//#define PROFILE_FFT
+
 #define LIS3DH_ADDR (0x18<<1)
 
+//a single I2C transaction, the longest is a full FIFO read at ~5ms, gets this long before the bus is reset
+#define I2C_TIMEOUT_MS 10
+//after a failure, wait this long before setting the accelerometer up again, doubling up to the max while it keeps failing
+#define ACCEL_BACKOFF_MIN_MS 10
+#define ACCEL_BACKOFF_MAX_MS 5000
+//a setup write that fails is tried again this many times before starting setup over after the back off
+#define ACCEL_CONFIG_RETRIES 3
+typedef void (*I2CCallback)(bool ok);
+
+//everything on the bus, with health counters
+typedef struct {
+	uint8_t addr;
+	volatile bool ready; //set once the device is set up, scheduled tasks only run while it's ready
+	uint16_t ok; //transactions that worked
+	uint16_t errors; //NACKs, bus errors, lost arbitration and anything else unexpected
+	uint16_t timeouts;
+} I2CDevice;
+extern I2CDevice accelerometerDevice;
+extern uint8_t accelFifoSrc;
+
+//reads that happen on their own every periodMs, see i2cTasks[] in i2c.c
+//done is called from the I2C interrupt after each one, and can chain more transactions on
+typedef struct {
+	I2CDevice * dev;
+	uint8_t reg;
+	uint8_t len;
+	void * dest;
+	uint16_t periodMs;
+	I2CCallback done;
+	uint32_t lastMs;
+} I2CTask;
+#define I2C_TASKS 1
+extern I2CTask i2cTasks[I2C_TASKS];
+
+//the accelerometer runs its FIFO in stream mode at this rate, and every ACCEL_POLL_MS whatever has piled up is read out
+//polling runs off SysTick so it keeps steady time no matter what audio processing is up to
+//100, 200, 400 or 1344Hz
+#ifndef ACCEL_ODR_HZ
+#define ACCEL_ODR_HZ 400
+#endif
+#ifndef ACCEL_POLL_MS
+#define ACCEL_POLL_MS 20
+#endif
+#define ACCEL_FIFO_SIZE 32
+#define ACCEL_1G 1333 //16g full scale is 12mg per count, left justified by 4 bits
+
+//tap and free-fall are detected by the accelerometer itself at the full rate and latched until the next poll
+//shake, orientation and tilt are worked out from each burst of samples
+#ifndef ACCEL_TAP_MG
+#define ACCEL_TAP_MG 1500
+#endif
+#ifndef ACCEL_FREEFALL_MG
+#define ACCEL_FREEFALL_MG 350
+#endif
+#ifndef ACCEL_SHAKE_MG
+#define ACCEL_SHAKE_MG 500
+#endif
+
+//motion events, as bits in AccelStats.events
+enum {
+	MOTION_TAP, MOTION_DOUBLE_TAP, MOTION_FREEFALL, MOTION_SHAKE, MOTION_ORIENTATION, MOTION_EVENTS
+};
+
+typedef struct {
+	int16_t mean[3]; //average of the samples since the last frame, what goes out as the accelerometer reading
+	uint16_t peak[3]; //largest absolute value seen on each axis
+	uint16_t rms; //rms of the movement around the mean, all 3 axes
+	uint16_t jerk; //largest change between 2 samples, all 3 axes added up, scaled down by 4
+	uint16_t samples; //how many samples since the last frame, 0 if nothing new came in
+	uint16_t sampleMs; //low 16 bits of ms when the newest sample was read
+	uint16_t shake; //rms smoothed over ~8 bursts
+	int16_t pitch; //tilt of the x axis out of level, 32768 = 180 degrees
+	int16_t roll; //rotation around the x axis
+	uint8_t orientation; //which axis is pointing up, axis * 2, +1 if it reads negative
+	uint8_t events; //1 << MOTION_* for everything seen since the last frame went out
+	uint16_t eventMs[MOTION_EVENTS]; //low 16 bits of ms when each event was last seen
+} AccelStats;
+extern AccelStats accelStats;
 
-extern const short Sinewave[];
+//append an "SM1.0" motion frame with the full AccelStats after each frame
+#ifndef DEFAULT_MOTION
+#define DEFAULT_MOTION 0
+#endif
+
+//the light sensor and analog inputs take turns being converted along with audio, so each is sampled at 1/6 the audio rate
+//they are summed over 1<<ANALOG_OVERSAMPLE_LOG2 samples for extra bits and less noise
+//then low pass filtered with a time constant of 1<<ANALOG_FILTER_SHIFT summed samples, about 40ms as set
+//ANALOG_DEADBAND is how far (of 65535) an input has to move before the output follows, 0 to disable
+#ifndef ANALOG_OVERSAMPLE_LOG2
+#define ANALOG_OVERSAMPLE_LOG2 4
+#endif
+#ifndef ANALOG_FILTER_SHIFT
+#define ANALOG_FILTER_SHIFT 3
+#endif
+#ifndef ANALOG_DEADBAND
+#define ANALOG_DEADBAND 8
+#endif
+#define ANALOG_INPUTS 6 //light, a0-a4
+extern volatile uint16_t analogValues[ANALOG_INPUTS]; //filtered 16 bit values, in output order
+
+//bins feeding the chromagram, see chroma.c
+#define CHROMA_LOW_FIRST_BIN 3
+#define CHROMA_LOW_BINS 8
+#define CHROMA_HIGH_FIRST_BIN (130 * HIGH_N / AUDIO_SAMPLE_RATE + 1) //first bin over 130Hz
+#define CHROMA_HIGH_BINS 128
+
+//what goes in each frame, see README.md for the layouts
+enum {
+	PAYLOAD_BANDS, //"SB1.0" 32 frequency bands, what a Pixelblaze expects
+	PAYLOAD_CHROMA //"SC1.0" 12 pitch class energies
+};
+#ifndef DEFAULT_PAYLOAD
+#define DEFAULT_PAYLOAD PAYLOAD_BANDS
+#endif
+
+//which fields go in the main frame. PROFILE_FULL is the plain "SB1.0" or "SC1.0" frame
+//the rest go out as "SP1.0" followed by a byte of FIELD_* flags saying what's in it, in this order
+enum {
+	PROFILE_FULL, //everything, what a Pixelblaze expects
+	PROFILE_AUDIO, //bands and energy
+	PROFILE_AUDIO_ACCEL, //bands, energy and accelerometer
+	PROFILE_SENSORS, //accelerometer, light and analog inputs, sent at PROFILE_SLOW_HZ with no audio processing
+	PROFILE_MULTIRATE, //separate frames for audio every block, accelerometer every poll and the rest at PROFILE_SLOW_HZ
+	PROFILES
+};
+#define FIELD_BANDS 0x01 //32 x uint16_t
+#define FIELD_CHROMA 0x02 //12 x uint16_t, instead of bands for PAYLOAD_CHROMA
+#define FIELD_ENERGY 0x04 //energy average, max frequency magnitude, max frequency Hz
+#define FIELD_ACCEL 0x08 //3 x int16_t
+#define FIELD_LIGHT 0x10 //uint16_t
+#define FIELD_ANALOG 0x20 //5 x uint16_t
+#define FIELD_AUDIO (FIELD_BANDS | FIELD_CHROMA | FIELD_ENERGY)
+#ifndef DEFAULT_PROFILE
+#define DEFAULT_PROFILE PROFILE_FULL
+#endif
+#ifndef PROFILE_SLOW_HZ
+#define PROFILE_SLOW_HZ 10
+#endif
+
+//send the main frame delta coded as "SD1.0" instead, see compress.c
+#ifndef DEFAULT_COMPRESS
+#define DEFAULT_COMPRESS 0
+#endif
+#define COMPRESS_KEYFRAME_INTERVAL 32
+#define COMPRESS_MAX_FIELDS 44 //32 bands, 3 for energy and max frequency, 3 accelerometer, 6 analog
+#define COMPRESS_KEYFRAME 0x01 //raw values follow instead of deltas
+#define COMPRESS_CHROMA 0x02 //fields are laid out like SC1.0 instead of SB1.0
+
+//how frames are separated on the wire, see output.c
+enum {
+	FRAMING_PLAIN, //each frame ends in "END", what a Pixelblaze expects
+	FRAMING_COBS //each frame is COBS encoded and ends in a 0
+};
+#ifndef DEFAULT_FRAMING
+#define DEFAULT_FRAMING FRAMING_PLAIN
+#endif
+
+//what the UART starts at and falls back to, what a Pixelblaze expects. the host can switch to faster rates, see command.c
+#define UART_BAUD 115200
+
+//settings that can be changed at runtime over the UART, the defines above are the defaults. see settings.c
+//the last page of flash is kept out of the linker script's ROM so they can be saved there
+#define SETTINGS_FLASH_ADDR 0x08003C00
+typedef struct {
+	uint8_t payload; //PAYLOAD_*
+	uint8_t motion; //1 to send the motion frame
+	uint8_t analogFilterShift; //ANALOG_FILTER_SHIFT
+	uint8_t compress; //1 to delta code the main frame
+	uint16_t analogDeadband; //ANALOG_DEADBAND
+	uint16_t shakeMg; //ACCEL_SHAKE_MG
+	uint8_t lowBands[6]; //top bin of each low frequency band
+	uint8_t highBands[26]; //top bin of each high frequency band
+	uint8_t framing; //FRAMING_*
+	uint8_t profile; //PROFILE_*
+} Settings;
+extern Settings settings;
+extern const Settings defaultSettings;
+
+
+extern const short SinewaveQuarter[];
+extern volatile uint32_t ms;
 extern int fix_fft(short fr[], short fi[], short m, short inverse);
 extern int32_t fix16_sqrt(int32_t inValue);
+extern const int16_t lowWindow[];
+extern const int16_t highWindow[];
+extern const uint8_t chromaLowMap[];
+extern const uint8_t chromaHighMap[];
+
+//Q15 sine of j/1024ths of a full turn, unfolded from the quarter wave table in fix_fft.c
+//tools/fft_check.c checks it against the old full table
+static inline short fixSin(int j) {
+	int quarter = 1 << (N_WAVE_LOG2 - 2);
+	int r = j & (quarter - 1);
+	switch ((j >> (N_WAVE_LOG2 - 2)) & 3) {
+	case 0:
+		return SinewaveQuarter[r];
+	case 1:
+		return SinewaveQuarter[quarter - r];
+	case 2:
+		return -SinewaveQuarter[r];
+	default:
+		return -SinewaveQuarter[quarter - r];
+	}
+}
+
+static inline short fixCos(int j) {
+	return fixSin(j + (1 << (N_WAVE_LOG2 - 2)));
+}
 
 void initRcc();
 void initTim1();
@@ -27,13 +279,61 @@ void initUart();
 void initDma();
 void initI2C();
 
+void initSettings();
+bool settingsValid(const Settings * s);
+bool saveSettings();
+void commandService();
+int commandTakeReply(char * out);
+char * compressFrame(char * frame, char * end);
+
+//the peripherals everything else runs on top of, main.c has them on the registers
+//and tools/sim/sim_board.c stands in for them on a PC. the clock is ms and cycleCount(),
+//and the ADC interrupt hands each pair of readings to acquireSample()
+uint32_t cycleCount();
 void writeToUsart(uint8_t * outBuffer, uint32_t len);
-void i2cWriteReg(uint8_t addr, uint8_t reg, uint8_t value);
-void i2cReadReg(uint8_t addr, uint8_t reg, uint8_t * value, uint8_t len);
-void initAccelerometer();
-void startAccelerometerPoll();
+bool usartIdle();
+//bytes from the host wait in a USART_RX_SIZE ring until they're read. if more come in than that before
+//they're read, the oldest are gone: usartRead() skips to what's still there and counts it in usartOverruns
+#define USART_RX_SIZE 64 //power of 2
+bool usartRead(uint8_t * c);
+extern uint16_t usartOverruns;
+void usartSetBaud(uint32_t baud);
+//one step of an I2C transaction at a time, i2cEvent() is called from the interrupt as each one finishes
+typedef enum {
+	I2C_EVENT_TX_READY, //the next byte can be sent
+	I2C_EVENT_TX_DONE, //everything was sent, without a stop
+	I2C_EVENT_RX_DONE, //everything was read
+	I2C_EVENT_STOP, //the stop went out, the transaction is over
+	I2C_EVENT_ERROR //NACK, bus error, lost arbitration, or something unexpected
+} I2CEvent;
+void i2cBusWrite(uint8_t addr, int len, bool stop);
+void i2cBusSend(uint8_t data, bool last);
+void i2cBusRead(uint8_t addr, void * dest, int len);
+void i2cBusOff();
+void i2cBusRecover();
+void i2cEvent(I2CEvent event);
+bool i2cWrite(I2CDevice * dev, uint8_t reg, uint8_t value, I2CCallback done);
+bool i2cRead(I2CDevice * dev, uint8_t reg, void * dest, int len, I2CCallback done);
+void i2cService();
+void accelerometerService();
+void accelerometerPollDone(bool ok);
 
-void processSensorData(int16_t * audioBuffer, int16_t * audio400HzBuffer, volatile uint16_t adcBuffer[7], volatile int16_t accelerometer[3]);
+void chromaAccumulate(uint32_t chroma[12], const uint16_t * magnitude, const uint8_t * map, int count);
+void dcBlock(int16_t * in, int m);
+uint16_t * fftRealWindowedMagnitude(int16_t * in, int m, const int16_t * window, uint16_t * energyAverage);
+void accelerometerProcessFifo(int16_t samples[][3], int count, uint32_t newestMs);
+void accelerometerProcessSources(uint8_t int1Src, uint8_t clickSrc);
+int16_t fixAtan2(int32_t y, int32_t x);
+int acquireSample(uint16_t audio, uint16_t slow);
+void acquireService();
+//the biggest frame, "SD1.0" delta coded with every field. COBS takes 2 less, a spare byte in front and the 0 instead of "END"
+//the motion frame and any command reply go out of the same buffer once the main frame is done with it
+#define OUT_BUFFER_SIZE (6 + 3 + COMPRESS_MAX_FIELDS * 2 + 4)
+void processSensorData(int16_t * audioBuffer, int16_t * audio400HzBuffer, volatile uint16_t analog[ANALOG_INPUTS]);
+void outputService(volatile uint16_t analog[ANALOG_INPUTS]);
+bool outputIdle();
+uint32_t outputBitsPerSecond(const Settings * s);
+extern uint16_t outputDropped;
 
 
 #endif
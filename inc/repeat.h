@@ -0,0 +1,19 @@
+#ifndef _REPEAT_H_
+#define _REPEAT_H_
+
+//expand M(b), M(b+1), ... M(b+n-1) so lookup tables can be generated by the compiler
+//n must be a literal power of 2 (or a macro that expands to one), M is expected to supply its own trailing comma
+#define REPEAT(n, M, b) REPEAT_(n, M, b)
+#define REPEAT_(n, M, b) REPEAT_##n(M, b)
+
+#define REPEAT_1(M, b) M(b)
+#define REPEAT_2(M, b) REPEAT_1(M, b) REPEAT_1(M, (b) + 1)
+#define REPEAT_4(M, b) REPEAT_2(M, b) REPEAT_2(M, (b) + 2)
+#define REPEAT_8(M, b) REPEAT_4(M, b) REPEAT_4(M, (b) + 4)
+#define REPEAT_16(M, b) REPEAT_8(M, b) REPEAT_8(M, (b) + 8)
+#define REPEAT_32(M, b) REPEAT_16(M, b) REPEAT_16(M, (b) + 16)
+#define REPEAT_64(M, b) REPEAT_32(M, b) REPEAT_32(M, (b) + 32)
+#define REPEAT_128(M, b) REPEAT_64(M, b) REPEAT_64(M, (b) + 64)
+#define REPEAT_256(M, b) REPEAT_128(M, b) REPEAT_128(M, (b) + 128)
+
+#endif
@@ -0,0 +1,154 @@
+#include "main.h"
+
+//LIS3DH setup and polling on top of the I2C transactions in i2c.c
+//setup is a list of register writes done one at a time from the I2C interrupt
+//once it's ready, the FIFO_SRC read in i2cTasks[] kicks off each poll every ACCEL_POLL_MS
+//a setup write that fails is tried again right away, up to ACCEL_CONFIG_RETRIES times
+//if that runs out or a poll fails the accelerometer readings go to 0 and setup starts over later, waiting twice as long each time
+//audio frames carry on regardless
+
+#if ACCEL_ODR_HZ == 100
+#define ACCEL_ODR_BITS 0b0101
+#elif ACCEL_ODR_HZ == 200
+#define ACCEL_ODR_BITS 0b0110
+#elif ACCEL_ODR_HZ == 400
+#define ACCEL_ODR_BITS 0b0111
+#elif ACCEL_ODR_HZ == 1344
+#define ACCEL_ODR_BITS 0b1001
+#else
+#error "unsupported ACCEL_ODR_HZ"
+#endif
+_Static_assert(ACCEL_ODR_HZ * ACCEL_POLL_MS / 1000 < ACCEL_FIFO_SIZE - 2, "the accelerometer FIFO would overflow between polls");
+//convert to the units used by the accelerometer's interrupt registers
+#define ACCEL_THS(mg) (((mg) + 93) / 186) //186mg per count at 16g
+#define ACCEL_ODR_COUNT(ms) ((ms) * ACCEL_ODR_HZ / 1000)
+
+//register, value pairs written in order
+static const uint8_t accelConfig[][2] = {
+		//CTRL_REG1(20h) - ODR = ACCEL_ODR_BITS | lpen off = 0 | xzy enable = 111
+		{0x20, ACCEL_ODR_BITS << 4 | 0b0111},
+		//CTRL_REG2(21h) - HPM normal = 00 | HPCF = 00 | FDS off = 0 | HPCLICK on = 1 | HP_IA off = 00
+		//so taps are detected without gravity, while the FIFO still gets unfiltered data
+		{0x21, 0b00000100},
+		//CTRL_REG4(23h) - BDU continuous = 1 | BLE big = 0 | FS 16g = 11 | HR high = 1 | ST off = 00 | SIM x = 0
+		{0x23, 0b10111000},
+		//CTRL_REG5(24h) - BOOT = 0 | FIFO_EN = 1 | LIR_INT1 latched = 1 | D4D and INT2 off = 000
+		{0x24, 0b01001000},
+		//INT1 is used for free-fall, nothing is wired to the pin, INT1_SRC gets polled
+		//INT1_CFG(30h) - AOI and = 1 | 6D = 0 | ZLIE YLIE XLIE = 1, all axes low at once
+		{0x30, 0b10010101},
+		{0x32, ACCEL_THS(ACCEL_FREEFALL_MG)}, //INT1_THS
+		{0x33, ACCEL_ODR_COUNT(30)}, //INT1_DURATION, falling for 30ms
+		//CLICK_CFG(38h) - single and double click on all axes
+		{0x38, 0b00111111},
+		//CLICK_THS(3Ah) - LIR_Click latched = 1 | threshold, same scale as INT1_THS
+		{0x3A, 0x80 | ACCEL_THS(ACCEL_TAP_MG)},
+		{0x3B, ACCEL_ODR_COUNT(50)}, //TIME_LIMIT, a tap is over within 50ms
+		{0x3C, ACCEL_ODR_COUNT(80)}, //TIME_LATENCY, quiet time before a second tap
+		{0x3D, ACCEL_ODR_COUNT(150)}, //TIME_WINDOW, to finish a double tap
+		//FIFO_CTRL_REG(2Eh) - bypass first to clear anything left over, then FM stream = 10 | TR = 0 | FTH = 0
+		{0x2E, 0b00000000},
+		{0x2E, 0b10000000},
+};
+#define ACCEL_CONFIG_STEPS (sizeof(accelConfig) / sizeof(accelConfig[0]))
+
+I2CDevice accelerometerDevice = {.addr = LIS3DH_ADDR};
+
+static enum {
+	ACCEL_BACKOFF, ACCEL_CONFIGURING, ACCEL_READY
+} accelState; //starts out in back off with nothing to wait for
+static int accelConfigStep;
+static int accelConfigTries; //failed tries at the current step
+static uint32_t accelRetryMs;
+static uint32_t accelBackoffMs = ACCEL_BACKOFF_MIN_MS;
+static uint32_t accelPollMs; //when the FIFO level was read, the newest sample is from about then
+
+//each poll reads how many samples are in the accelerometer FIFO, reads them all out in one burst
+//then picks up the latched free-fall and click sources
+static enum {
+	FIFO_LEVEL, FIFO_DATA, INT1_SOURCE, CLICK_SOURCE, ACCEL_STEPS
+} accelStep;
+
+//a poll reads up to twice what piles up between polls, more only happens when one was held up
+//whatever's over stays in the FIFO for the next one, which keeps accelFifo half the size of the FIFO at 400Hz
+#define ACCEL_READ_MAX (2 * ACCEL_ODR_COUNT(ACCEL_POLL_MS) < ACCEL_FIFO_SIZE ? 2 * ACCEL_ODR_COUNT(ACCEL_POLL_MS) : ACCEL_FIFO_SIZE)
+
+//updated by DMA
+uint8_t accelFifoSrc; //FIFO_SRC_REG, read by the scheduled task
+static int accelFifoCount;
+static int accelFifoLeft; //samples left in the FIFO behind the ones being read
+static int16_t accelFifo[ACCEL_READ_MAX][3];
+static uint8_t accelSources[2]; //INT1_SRC, CLICK_SRC
+//register to start at for each step, set MSB to increment per read
+//the FIFO data wraps from OUT_Z_H back around to OUT_X_L for each sample
+static const uint8_t accelStepReg[ACCEL_STEPS] = {0x2F, 0x28 | 0x80, 0x31, 0x39};
+static uint8_t * const accelStepDest[ACCEL_STEPS] = {&accelFifoSrc, (uint8_t *) accelFifo, &accelSources[0], &accelSources[1]};
+
+static void accelFault() {
+	accelerometerDevice.ready = false;
+	accelState = ACCEL_BACKOFF;
+	accelStep = FIFO_LEVEL;
+	accelRetryMs = ms + accelBackoffMs;
+	accelBackoffMs = accelBackoffMs * 2 > ACCEL_BACKOFF_MAX_MS ? ACCEL_BACKOFF_MAX_MS : accelBackoffMs * 2;
+	//stale readings would look like the board is frozen in place
+	memset(accelStats.mean, 0, sizeof(accelStats.mean));
+	accelStats.samples = 0;
+}
+
+static void accelConfigDone(bool ok) {
+	if (ok) {
+		accelConfigTries = 0;
+		if (++accelConfigStep == ACCEL_CONFIG_STEPS) {
+			accelState = ACCEL_READY;
+			accelerometerDevice.ready = true;
+			return;
+		}
+	} else if (++accelConfigTries > ACCEL_CONFIG_RETRIES) {
+		accelFault();
+		return;
+	}
+	//on to the next write, or the same one again. the bus is free, a failure has already been cleared up
+	if (!i2cWrite(&accelerometerDevice, accelConfig[accelConfigStep][0], accelConfig[accelConfigStep][1], accelConfigDone))
+		accelFault();
+}
+
+//called after each step of a poll, chains on the next one
+void accelerometerPollDone(bool ok) {
+	if (!ok) {
+		accelFault();
+		return;
+	}
+	if (accelStep == FIFO_LEVEL) {
+		accelPollMs = ms;
+		//FSS is the number of unread samples, OVRN means it filled up
+		int waiting = accelFifoSrc & 0x40 ? ACCEL_FIFO_SIZE : accelFifoSrc & 0x1f;
+		accelFifoCount = waiting < ACCEL_READ_MAX ? waiting : ACCEL_READ_MAX;
+		accelFifoLeft = waiting - accelFifoCount;
+	} else if (accelStep == FIFO_DATA) {
+		//the oldest come out first, the newest read is from a sample time for each one left behind it
+		accelerometerProcessFifo(accelFifo, accelFifoCount, accelPollMs - accelFifoLeft * 1000 / ACCEL_ODR_HZ);
+	}
+	accelStep++;
+	if (accelStep == FIFO_DATA && accelFifoCount == 0)
+		accelStep++;
+	if (accelStep == ACCEL_STEPS) {
+		accelerometerProcessSources(accelSources[0], accelSources[1]);
+		accelBackoffMs = ACCEL_BACKOFF_MIN_MS; //it's working again
+		accelStep = FIFO_LEVEL; //ready for the next scheduled one
+		return;
+	}
+	int len = accelStep == FIFO_DATA ? accelFifoCount * 6 : 1;
+	if (!i2cRead(&accelerometerDevice, accelStepReg[accelStep], accelStepDest[accelStep], len, accelerometerPollDone))
+		accelFault();
+}
+
+//call every ms from SysTick, (re)starts setup once any back off is over
+void accelerometerService() {
+	if (accelState == ACCEL_BACKOFF && (int32_t) (ms - accelRetryMs) >= 0) {
+		accelState = ACCEL_CONFIGURING;
+		accelConfigStep = 0;
+		accelConfigTries = 0;
+		if (!i2cWrite(&accelerometerDevice, accelConfig[0][0], accelConfig[0][1], accelConfigDone))
+			accelFault();
+	}
+}
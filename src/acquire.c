@@ -0,0 +1,104 @@
+#include "main.h"
+
+//what happens to each pair of ADC readings, and handing off each finished block of audio
+//none of this touches the hardware, the DMA interrupt in main.c feeds it and does the channel switching
+//so tools/sim runs exactly the same code on a PC
+
+//oversampled and filtered light sensor and analog inputs, see ANALOG_OVERSAMPLE_LOG2
+//audio is converted on every trigger, the slow channels take turns riding along with it
+_Static_assert(ANALOG_OVERSAMPLE_LOG2 >= 4 && ANALOG_OVERSAMPLE_LOG2 <= 20, "sums are scaled down to 16 bits");
+static struct {
+	uint32_t sum[ANALOG_INPUTS];
+	int slot; //which input is being converted along with audio
+	int count; //complete rounds of all inputs
+	int32_t filtered[ANALOG_INPUTS]; //16 bits + 8 bits of fraction
+} analogInputs;
+volatile uint16_t analogValues[ANALOG_INPUTS]; //filtered 16 bit values, in output order
+
+//ping-pong buffer for main audio at AUDIO_SAMPLE_RATE, stored in FFT_SLOT order
+//the fft runs in place, so the side being processed ends up holding its magnitudes
+static volatile bool readDone;
+static int readSide;
+static int readPos;
+static int16_t buffer[2][HIGH_N];
+
+//circular buffer for low frequency stuff - we need to reuse parts of it and can afford the memory
+//the 32 samples cover 32 * LOW_DECIMATION samples of the original audio (1600 at 20KHz)
+_Static_assert(AUDIO_SAMPLE_RATE % LOW_SAMPLE_RATE == 0, "the audio rate has to decimate evenly to the low frequency rate");
+static struct {
+	int16_t circular[32];
+	int16_t output[32]; //FFT_SLOT order, holds magnitudes after processing
+	int head;
+	//keep track of how many samples have passed through the filter to know when to sample from it
+	int downSampleCounter;
+	int32_t avg;
+} bufferLowHz;
+
+/*
+ * Takes the 12 bit audio reading and the slow channel that was converted along with it
+ * returns which slow channel should be converted next
+ */
+int acquireSample(uint16_t audio, uint16_t slow) {
+	//audio is saved raw, dc is removed a block at a time by dcBlock()
+	int16_t audioSample = audio<<3;
+
+	//downsample for the low frequency buffer, 50:1 at 20KHz
+	bufferLowHz.avg += audioSample;
+	if (++bufferLowHz.downSampleCounter >= LOW_DECIMATION) {
+		bufferLowHz.downSampleCounter = 0;
+		bufferLowHz.circular[bufferLowHz.head++] = bufferLowHz.avg/LOW_DECIMATION;
+		bufferLowHz.avg = 0;
+		if (bufferLowHz.head >= 32)
+			bufferLowHz.head = 0;
+	}
+
+	//accumulate the slow channel that came along with this sample and line up the next one
+	int slot = analogInputs.slot;
+	analogInputs.sum[slot] += slow;
+	if (++slot >= ANALOG_INPUTS) {
+		slot = 0;
+		//decimate and filter once enough rounds have been summed
+		if (++analogInputs.count >= 1 << ANALOG_OVERSAMPLE_LOG2) {
+			analogInputs.count = 0;
+			for (int i = 0; i < ANALOG_INPUTS; i++) {
+				//12 bits + ANALOG_OVERSAMPLE_LOG2 down to 16
+				int32_t v = analogInputs.sum[i] >> (ANALOG_OVERSAMPLE_LOG2 - 4);
+				analogInputs.sum[i] = 0;
+				analogInputs.filtered[i] += ((v << 8) - analogInputs.filtered[i]) >> settings.analogFilterShift;
+				analogValues[i] = analogInputs.filtered[i] >> 8;
+			}
+		}
+	}
+	analogInputs.slot = slot;
+
+	//save to the ping-pong buffer
+	buffer[readSide][FFT_SLOT(readPos, HIGH_NLOG2)] = audioSample;
+
+	readPos++;
+	if (readPos >= HIGH_N) {
+		//copy the 400 hz buffer snapshot
+		for (int i = 0; i < LOW_N; i++) {
+			bufferLowHz.output[FFT_SLOT(i, LOW_NLOG2)] = bufferLowHz.circular[(bufferLowHz.head + i) & 31];
+		}
+		//toggle sides and mark done
+		readSide = !readSide;
+		readPos = 0;
+		readDone = true;
+	}
+	return slot;
+}
+
+//call from the main loop, processes and sends a block of audio once one is ready
+void acquireService() {
+	//listen for message that the sample buffer is ready to process
+	if (readDone) {
+		readDone = false;
+
+//		GPIO_WriteBit(GPIOB, GPIO_Pin_1, 1);
+
+		//grab the side we're not currently writing to and do an FFT on it
+		processSensorData(&buffer[!readSide][0], &bufferLowHz.output[0], analogValues);
+
+//		GPIO_WriteBit(GPIOB, GPIO_Pin_1, 0);
+	}
+}
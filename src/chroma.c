@@ -0,0 +1,41 @@
+#include "main.h"
+#include "repeat.h"
+
+//a chromagram folds the spectrum into 12 pitch classes (C, C#, D ... B) regardless of octave
+//each fft bin is split between the 2 nearest pitch classes based on where its center frequency falls
+//the tables are generated by the compiler, each entry holds the pitch class below the bin in the top 4 bits
+//and how much of the bin belongs to the next pitch class up in 16ths in the bottom 4 bits
+
+//C0, everything is relative to this. A4 is 440Hz
+#define CHROMA_C0_HZ 16.351597831287414
+#define CHROMA_PITCH(hz) (12.0 * __builtin_log2((hz) / CHROMA_C0_HZ))
+#define CHROMA_ENTRY(hz) (uint8_t) (((int) __builtin_fmod(CHROMA_PITCH(hz), 12.0) << 4) | \
+		(int) ((CHROMA_PITCH(hz) - __builtin_floor(CHROMA_PITCH(hz))) * 16)),
+
+//the 400Hz buffer covers octaves 1-2 from 37.5-125Hz with its 12.5Hz bins
+#define CHROMA_LOW_ENTRY(k) CHROMA_ENTRY((k) * (double) LOW_SAMPLE_RATE / LOW_N)
+const uint8_t chromaLowMap[CHROMA_LOW_BINS] = {
+		REPEAT(CHROMA_LOW_BINS, CHROMA_LOW_ENTRY, CHROMA_LOW_FIRST_BIN)
+};
+
+//the high frequency buffer picks up above 130Hz for the next 128 bins, 156Hz to ~5KHz at 20KHz
+//above that is mostly harmonics and noise
+#define CHROMA_HIGH_ENTRY(k) CHROMA_ENTRY((k) * (double) AUDIO_SAMPLE_RATE / HIGH_N)
+const uint8_t chromaHighMap[CHROMA_HIGH_BINS] = {
+		REPEAT(CHROMA_HIGH_BINS, CHROMA_HIGH_ENTRY, CHROMA_HIGH_FIRST_BIN)
+};
+
+/*
+ * Adds count bucket magnitudes into the 12 pitch class totals in one pass
+ * map is one of the tables above, magnitude should already point at the first bin the map covers
+ * totals are 16x the magnitudes due to the weighting
+ */
+void chromaAccumulate(uint32_t chroma[12], const uint16_t * magnitude, const uint8_t * map, int count) {
+	for (int i = 0; i < count; i++) {
+		uint32_t m = magnitude[i];
+		int pc = map[i] >> 4;
+		uint32_t w = map[i] & 0xf;
+		chroma[pc] += m * (16 - w);
+		chroma[pc == 11 ? 0 : pc + 1] += m * w;
+	}
+}
@@ -0,0 +1,254 @@
+#include "main.h"
+
+//binary commands from the host, received by DMA into a circular buffer and handled from the main loop
+//each command is 0xA5, command, length, data[length], checksum
+//where checksum is the low 8 bits of command + length + all the data bytes, inverted
+//every command gets a reply frame, sent right after the next sensor frame:
+//"SR1.0\0", command, status, length, data[length], then "END\0" or however settings.framing ends frames
+
+#define COMMAND_SYNC 0xA5
+#define COMMAND_MAX_DATA 32
+#define COMMAND_TIMEOUT_MS 50 //a command has to arrive in one go, a gap this long starts over
+
+//the host can ask for another baud rate, faster or slower as long as the frames still fit, see outputBitsPerSecond()
+//any rate but UART_BAUD has to be kept alive with commands, a Pixelblaze can't find the board at either.
+//if the host goes quiet for BAUD_SILENCE_MS it's back to UART_BAUD
+#define BAUD_MIN 9600
+#define BAUD_MAX 3000000 //48MHz / 16
+#define BAUD_SILENCE_MS 2000
+
+enum {
+	CMD_GET = 1, //data is a parameter, replies with its value
+	CMD_SET, //data is a parameter followed by its new value
+	CMD_PAYLOAD, //data is a PAYLOAD_* to switch to, same as setting PARAM_PAYLOAD
+	CMD_RESET_STATS, //zero the I2C health counters, dropped frame count and rx overruns
+	CMD_SAVE, //write the current settings to flash so they're used from startup
+	CMD_DEFAULTS, //go back to the built in settings, save afterwards to make it stick
+	CMD_BAUD, //data is a uint32_t baud rate, switches over once the reply has gone out
+};
+
+enum {
+	STATUS_OK, STATUS_CHECKSUM, STATUS_UNKNOWN, STATUS_INVALID, STATUS_FLASH
+};
+
+enum {
+	PARAM_PAYLOAD, //uint8_t PAYLOAD_*
+	PARAM_MOTION, //uint8_t 1 to send the motion frame
+	PARAM_ANALOG_FILTER_SHIFT, //uint8_t 0-8
+	PARAM_ANALOG_DEADBAND, //uint16_t
+	PARAM_SHAKE_MG, //uint16_t
+	PARAM_LOW_BANDS, //6 x uint8_t top fft bin of each low band
+	PARAM_HIGH_BANDS, //26 x uint8_t top fft bin of each high band
+	PARAM_ACCEL_HEALTH, //3 x uint16_t ok, errors and timeouts, read only
+	PARAM_COMPRESS, //uint8_t 1 to delta code the main frame
+	PARAM_FRAMING, //uint8_t FRAMING_*
+	PARAM_PROFILE, //uint8_t PROFILE_*
+	PARAM_DROPPED, //uint16_t blocks of audio that weren't sent because the uart was still busy, read only
+	PARAM_RX_OVERRUNS, //uint16_t times commands came in faster than they were read and some were lost, read only
+	PARAMS
+};
+
+static const struct {
+	void * value;
+	uint8_t size;
+	bool writable; //settings can be set, everything else is just to look at
+} params[PARAMS] = {
+		{&settings.payload, 1, true},
+		{&settings.motion, 1, true},
+		{&settings.analogFilterShift, 1, true},
+		{&settings.analogDeadband, 2, true},
+		{&settings.shakeMg, 2, true},
+		{&settings.lowBands, 6, true},
+		{&settings.highBands, 26, true},
+		{&accelerometerDevice.ok, 6, false},
+		{&settings.compress, 1, true},
+		{&settings.framing, 1, true},
+		{&settings.profile, 1, true},
+		{&outputDropped, 2, false},
+		{&usartOverruns, 2, false},
+};
+
+static struct {
+	enum {
+		WAIT_SYNC, WAIT_COMMAND, WAIT_LENGTH, WAIT_DATA, WAIT_CHECKSUM
+	} state;
+	uint8_t command;
+	uint8_t len;
+	uint8_t pos;
+	uint8_t sum;
+	uint8_t data[COMMAND_MAX_DATA];
+	uint32_t lastMs;
+} parser;
+
+//one reply waits for the next frame at a time, more commands aren't read until it's gone out
+//so the host has to wait for each reply before sending the next command, or the rx ring can overflow
+//it's kept as what to say rather than the frame, which gets written straight into the output when it goes
+//the data is only ever a parameter's value for CMD_GET, read when the reply goes out rather than when the command came in
+static struct {
+	uint8_t command;
+	uint8_t status;
+	uint8_t len;
+	const void * data;
+} reply;
+static int replyLen; //bytes the frame takes before it's ended, 0 if there's no reply waiting
+_Static_assert(6 + 3 + COMMAND_MAX_DATA + 4 <= OUT_BUFFER_SIZE, "a reply has to fit the output buffer");
+
+static uint32_t baud = UART_BAUD;
+static uint32_t baudPending; //switch to this once the reply has gone out
+static uint32_t lastCommandMs;
+
+static void commandReply(uint8_t status, const void * data, int len) {
+	reply.command = parser.command;
+	reply.status = status;
+	reply.len = len;
+	reply.data = data;
+	replyLen = 6 + 3 + len;
+}
+
+static void setBaud(uint32_t rate) {
+	usartSetBaud(rate);
+	baud = rate;
+}
+
+static void commandRun() {
+	uint8_t * data = parser.data;
+	int len = parser.len;
+	lastCommandMs = ms;
+	switch (parser.command) {
+	case CMD_GET:
+		if (len != 1 || data[0] >= PARAMS) {
+			commandReply(STATUS_INVALID, NULL, 0);
+			break;
+		}
+		commandReply(STATUS_OK, params[data[0]].value, params[data[0]].size);
+		break;
+	case CMD_PAYLOAD:
+		//same as a set, shuffle it into that form
+		data[1] = data[0];
+		data[0] = PARAM_PAYLOAD;
+		len++;
+		//fall through
+	case CMD_SET: {
+		if (len < 1 || data[0] >= PARAMS || !params[data[0]].writable || len - 1 != params[data[0]].size) {
+			commandReply(STATUS_INVALID, NULL, 0);
+			break;
+		}
+		//try it out on a copy first
+		Settings s = settings;
+		int offset = (uint8_t *) params[data[0]].value - (uint8_t *) &settings;
+		memcpy((uint8_t *) &s + offset, &data[1], len - 1);
+		if (!settingsValid(&s)) {
+			commandReply(STATUS_INVALID, NULL, 0);
+			break;
+		}
+		memcpy(params[data[0]].value, &data[1], len - 1);
+		commandReply(STATUS_OK, NULL, 0);
+		break;
+	}
+	case CMD_RESET_STATS:
+		accelerometerDevice.ok = accelerometerDevice.errors = accelerometerDevice.timeouts = 0;
+		outputDropped = usartOverruns = 0;
+		commandReply(STATUS_OK, NULL, 0);
+		break;
+	case CMD_SAVE:
+		commandReply(saveSettings() ? STATUS_OK : STATUS_FLASH, NULL, 0);
+		break;
+	case CMD_DEFAULTS:
+		settings = defaultSettings;
+		commandReply(STATUS_OK, NULL, 0);
+		break;
+	case CMD_BAUD: {
+		uint32_t rate;
+		if (len != 4) {
+			commandReply(STATUS_INVALID, NULL, 0);
+			break;
+		}
+		memcpy(&rate, data, 4);
+		//too slow for the frames and most blocks would be dropped
+		if (rate < BAUD_MIN || rate > BAUD_MAX || rate < outputBitsPerSecond(&settings)) {
+			commandReply(STATUS_INVALID, NULL, 0);
+			break;
+		}
+		//the ok goes out at the old rate, the host should switch once it sees it
+		baudPending = rate;
+		commandReply(STATUS_OK, NULL, 0);
+		break;
+	}
+	default:
+		commandReply(STATUS_UNKNOWN, NULL, 0);
+		break;
+	}
+}
+
+//call from the main loop, works through whatever has come in
+void commandService() {
+	//change speed between frames, once the reply agreeing to it is out
+	if (baudPending && !replyLen && outputIdle()) {
+		setBaud(baudPending);
+		baudPending = 0;
+		lastCommandMs = ms;
+	} else if (baud != UART_BAUD && ms - lastCommandMs > BAUD_SILENCE_MS && outputIdle()) {
+		setBaud(UART_BAUD);
+	}
+
+	if (parser.state != WAIT_SYNC && ms - parser.lastMs > COMMAND_TIMEOUT_MS)
+		parser.state = WAIT_SYNC;
+
+	static uint16_t lastOverruns;
+	uint8_t c;
+	while (!replyLen && usartRead(&c)) {
+		parser.lastMs = ms;
+		//some of what came in was lost, whatever command it was part of is gone with it
+		if (usartOverruns != lastOverruns) {
+			lastOverruns = usartOverruns;
+			parser.state = WAIT_SYNC;
+		}
+
+		switch (parser.state) {
+		case WAIT_SYNC:
+			if (c == COMMAND_SYNC)
+				parser.state = WAIT_COMMAND;
+			break;
+		case WAIT_COMMAND:
+			parser.command = c;
+			parser.sum = c;
+			parser.state = WAIT_LENGTH;
+			break;
+		case WAIT_LENGTH:
+			parser.len = c;
+			parser.pos = 0;
+			parser.sum += c;
+			parser.state = c > COMMAND_MAX_DATA ? WAIT_SYNC : c ? WAIT_DATA : WAIT_CHECKSUM;
+			break;
+		case WAIT_DATA:
+			parser.data[parser.pos++] = c;
+			parser.sum += c;
+			if (parser.pos == parser.len)
+				parser.state = WAIT_CHECKSUM;
+			break;
+		case WAIT_CHECKSUM:
+			//the checksum is the sum inverted, so the two add up to 0xff
+			if ((uint8_t) (parser.sum + c) == 0xff)
+				commandRun();
+			else
+				commandReply(STATUS_CHECKSUM, NULL, 0);
+			parser.state = WAIT_SYNC;
+			break;
+		}
+	}
+}
+
+//write any waiting reply frame to the output, not ended yet. returns how many bytes, 0 if there isn't one
+int commandTakeReply(char * out) {
+	int len = replyLen;
+	if (len) {
+		memcpy(out, "SR1.0", 6);
+		out += 6;
+		*out++ = reply.command;
+		*out++ = reply.status;
+		*out++ = reply.len;
+		memcpy(out, reply.data, reply.len);
+	}
+	replyLen = 0;
+	return len;
+}
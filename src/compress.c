@@ -0,0 +1,54 @@
+#include "main.h"
+
+//optional delta coding for the main frame, most bands only move a little from one frame to the next
+//each field is sent as the change from the last frame, zigzagged so small negative changes stay small
+//then as a varint, 7 bits per byte with the top bit set if more follow. 1 byte for changes of -64 to 63
+//every COMPRESS_KEYFRAME_INTERVAL frames, or whenever deltas wouldn't save anything, the raw values go instead
+//the sequence number lets a receiver notice a dropped frame and wait for the next keyframe
+//tools/sd_codec.py decodes these and works out how well it does on a capture
+
+/*
+ * Rewrites an SB1.0 or SC1.0 frame that's been written up to end, before its "END", as SD1.0
+ * "SD1.0\0", flags, field count, sequence number, then the fields. returns the new end
+ */
+char * compressFrame(char * frame, char * end) {
+	static uint16_t last[COMPRESS_MAX_FIELDS];
+	static uint8_t lastFlags, lastCount, sequence, sinceKeyframe;
+	uint16_t fields[COMPRESS_MAX_FIELDS];
+	int count = (end - frame - 6) / 2;
+	uint8_t flags = frame[1] == 'C' ? COMPRESS_CHROMA : 0;
+	memcpy(fields, frame + 6, count * 2);
+
+	memcpy(frame, "SD1.0", 6);
+	uint8_t * out = (uint8_t *) frame + 6;
+	out[1] = count;
+	out[2] = sequence++;
+	out += 3;
+	uint8_t * data = out;
+
+	bool keyframe = ++sinceKeyframe >= COMPRESS_KEYFRAME_INTERVAL || flags != lastFlags || count != lastCount;
+	for (int i = 0; i < count && !keyframe; i++) {
+		int16_t d = fields[i] - last[i];
+		uint16_t z = (uint16_t) ((uint16_t) d << 1) ^ (d < 0 ? 0xffff : 0);
+		while (z >= 0x80) {
+			*out++ = z | 0x80;
+			z >>= 7;
+		}
+		*out++ = z;
+		//no bigger than raw, ever
+		if (out - data > count * 2)
+			keyframe = true;
+	}
+	if (keyframe) {
+		out = data;
+		memcpy(out, fields, count * 2);
+		out += count * 2;
+		sinceKeyframe = 0;
+	}
+	data[-3] = flags | (keyframe ? COMPRESS_KEYFRAME : 0);
+
+	memcpy(last, fields, count * 2);
+	lastFlags = flags;
+	lastCount = count;
+	return (char *) out;
+}
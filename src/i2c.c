@@ -0,0 +1,181 @@
+#include "main.h"
+
+//interrupt and DMA driven I2C transactions, one at a time
+//each is a single register write or a register read, and finishes by calling back with whether it worked
+//if a transaction trips an error or runs past I2C_TIMEOUT_MS the peripheral is shut off,
+//then i2cService() clears the bus from SysTick and reports the failure. nothing here ever waits on the bus
+//on top of that, the reads in i2cTasks[] are started whenever they're due and the bus is free
+//that's a fixed table, not a queue: one entry per read, and transfers never overlap,
+//so a task that comes due while the bus is busy starts once the transfer on it finishes
+//every transaction is counted against its device, have a look at the I2CDevice counters with the debugger
+//the registers are in main.c behind i2cBus*(), this is just the sequencing, so it runs in tools/sim too
+
+//reads that run on their own, sharing the bus with DMA channel 3. for now it's the one entry
+//other sensors can go here too, e.g. a temperature sensor read once a second:
+//{&temperatureDevice, 0x00, 2, &temperature, 1000, NULL, 0},
+I2CTask i2cTasks[I2C_TASKS] = {
+		//accelerometer FIFO_SRC, how many samples are waiting. the callback reads them out
+		{&accelerometerDevice, 0x2F, 1, &accelFifoSrc, ACCEL_POLL_MS, accelerometerPollDone, 0},
+};
+
+static volatile enum {
+	IDLE, STARTING, SENDING_REG, SENDING_VALUE, READING, STOPPING, FAULT
+} I2CMode;
+
+static struct {
+	I2CDevice * dev;
+	uint8_t reg;
+	uint8_t value;
+	void * dest;
+	int len; //bytes to read, 0 for a write
+	I2CCallback done;
+	uint32_t startMs;
+} transfer;
+
+//shutting the peripheral off resets its state machine and lets go of the bus
+static void i2cStop() {
+	i2cBusOff();
+	I2CMode = FAULT;
+}
+
+static void i2cFault() {
+	transfer.dev->errors++;
+	i2cStop();
+}
+
+//start a transaction by initiating a start and sending the slave address, the interrupt handler takes it from there
+static bool i2cBegin(I2CDevice * dev, uint8_t reg, uint8_t value, void * dest, int len, I2CCallback done) {
+	//i2cService() in SysTick and callbacks in the I2C interrupt can both get here
+	__disable_irq();
+	if (I2CMode != IDLE) {
+		__enable_irq();
+		return false;
+	}
+	I2CMode = STARTING;
+	__enable_irq();
+	transfer.dev = dev;
+	transfer.reg = reg;
+	transfer.value = value;
+	transfer.dest = dest;
+	transfer.len = len;
+	transfer.done = done;
+	transfer.startMs = ms;
+	//a read sends the register then restarts to read, a write sends the register and value then stops
+	if (len)
+		i2cBusWrite(dev->addr, 1, false);
+	else
+		i2cBusWrite(dev->addr, 2, true);
+	return true;
+}
+
+//write a single value to a register. returns false if another transaction is still running
+bool i2cWrite(I2CDevice * dev, uint8_t reg, uint8_t value, I2CCallback done) {
+	return i2cBegin(dev, reg, value, NULL, 0, done);
+}
+
+//read len bytes starting at reg into dest with DMA. returns false if another transaction is still running
+bool i2cRead(I2CDevice * dev, uint8_t reg, void * dest, int len, I2CCallback done) {
+	return i2cBegin(dev, reg, 0, dest, len, done);
+}
+
+//start the next task that's due on a ready device, round robin so a busy one can't starve the rest
+static void i2cSchedule() {
+	static int next;
+	for (int i = 0; i < I2C_TASKS; i++) {
+		int n = (next + i) % I2C_TASKS;
+		I2CTask * task = &i2cTasks[n];
+		if (task->dev->ready && ms - task->lastMs >= task->periodMs) {
+			if (i2cRead(task->dev, task->reg, task->dest, task->len, task->done)) {
+				task->lastMs = ms;
+				next = n + 1;
+			}
+			return;
+		}
+	}
+}
+
+//call every ms from SysTick. times out stuck transactions, recovers from faults, and starts any tasks that are due
+void i2cService() {
+	__disable_irq();
+	if (I2CMode != IDLE && I2CMode != FAULT && ms - transfer.startMs > I2C_TIMEOUT_MS) {
+		transfer.dev->timeouts++;
+		i2cStop();
+	}
+	__enable_irq();
+
+	if (I2CMode == FAULT) {
+		i2cBusRecover();
+		I2CMode = IDLE;
+		if (transfer.done)
+			transfer.done(false);
+	}
+	i2cSchedule();
+}
+
+static void i2cFinish() {
+	transfer.dev->ok++;
+	I2CMode = IDLE;
+	//the callback is free to chain on the next transaction, if it doesn't keep the bus busy with whatever is due
+	if (transfer.done)
+		transfer.done(true);
+	i2cSchedule();
+}
+
+//the next step of the transaction, an event that doesn't fit where it's at is a fault
+void i2cEvent(I2CEvent event) {
+	if (event == I2C_EVENT_ERROR) {
+		i2cFault();
+		return;
+	}
+	switch (I2CMode) {
+	case STARTING:
+		if (event != I2C_EVENT_TX_READY) {
+			i2cFault();
+			return;
+		}
+		if (transfer.len) {
+			I2CMode = SENDING_REG;
+			i2cBusSend(transfer.reg, true);
+		} else {
+			I2CMode = SENDING_VALUE;
+			i2cBusSend(transfer.reg, false);
+		}
+		break;
+	case SENDING_VALUE:
+		//the stop goes out on its own after this
+		if (event != I2C_EVENT_TX_READY) {
+			i2cFault();
+			return;
+		}
+		I2CMode = STOPPING;
+		i2cBusSend(transfer.value, true);
+		break;
+	case SENDING_REG:
+		if (event != I2C_EVENT_TX_DONE) {
+			i2cFault();
+			return;
+		}
+		I2CMode = READING;
+		i2cBusRead(transfer.dev->addr, transfer.dest, transfer.len);
+		break;
+	case READING:
+		//DMA is handling the reads, anything but it finishing is probably an error
+		if (event != I2C_EVENT_RX_DONE) {
+			i2cFault();
+			return;
+		}
+		I2CMode = STOPPING;
+		break;
+	case STOPPING:
+		if (event != I2C_EVENT_STOP) {
+			i2cFault();
+			return;
+		}
+		i2cFinish();
+		break;
+	case IDLE:
+	case FAULT:
+		//don't care really
+		break;
+	}
+}
@@ -2,35 +2,25 @@
 #include "main.h"
 
 
-enum {
-	IDLE, STARTING, SENDING_REG, READING, STOPPING, NEEDSRESET
-} I2CMode = NEEDSRESET;
-
-
-uint32_t audioAverage = 16384<<16;
-volatile uint16_t adcBuffer[7]; //updated by DMA @ 20KHz
-volatile int16_t accelerometer[3]; //updated by DMA
+volatile uint16_t adcBuffer[2]; //updated by DMA @ AUDIO_SAMPLE_RATE, audio then whichever slow channel is scheduled
 volatile uint32_t ms = 0; //updated by SysTick
 
+//commands from the host, received by DMA into a circular buffer, see usartRead()
+static uint8_t rxBuffer[USART_RX_SIZE];
+static volatile uint32_t rxHalves; //halves of rxBuffer the DMA has filled, counted by its interrupt
+static uint32_t rxRead; //bytes taken out so far
+uint16_t usartOverruns;
 
-//ping-pong buffer for main 20KHz audio
-volatile bool readDone;
-int readSide;
-int readPos;
-int16_t buffer[2][HIGH_N];
+//slow channels converted along with audio, one per trigger, see acquire.c
+const uint32_t analogChannels[ANALOG_INPUTS] = { //light, a0-a4
+		ADC_CHSELR_CHSEL1, ADC_CHSELR_CHSEL4, ADC_CHSELR_CHSEL9, ADC_CHSELR_CHSEL7, ADC_CHSELR_CHSEL6, ADC_CHSELR_CHSEL5
+};
 
-//circular buffer for low frequency stuff - we need to reuse parts of it and can afford the memory
-//the 32 samples cover 1600 samples of the original audio
-struct {
-	int16_t circular[32];
-	int16_t output[32];
-	int head;
-	//keep track of how many samples have passed through the filter to know when to sample from it
-	int downSampleCounter;
-	int32_t avg;
-} bufferLowHz;
+//2 conversions of (71.5 + 12.5) cycles at 14MHz take 12us, leave some room to handle the interrupt
+_Static_assert(AUDIO_SAMPLE_RATE <= 40000, "the ADC can't keep up with sample rates over 40KHz");
 
 int main(void) {
+	initSettings();
 	SysTick_Config(SystemCoreClock/1000); //tick interval 1ms
 	initRcc();
 	initTim1();
@@ -41,25 +31,12 @@ int main(void) {
 	initI2C();
 
 	for (;;) {
-
-		if (I2CMode == NEEDSRESET)
-			initAccelerometer();
-
-		//listen for message that the sample buffer is ready to process
-		if (readDone) {
-			readDone = false;
-
-//			GPIO_WriteBit(GPIOB, GPIO_Pin_1, 1);
-
-			//start polling the accelerometer now, it can run in the background while the FFT processes
-			startAccelerometerPoll();
-
-			//grab the side we're not currently writing to and do an FFT on it
-			processSensorData(&buffer[!readSide][0], &bufferLowHz.output[0], adcBuffer, accelerometer);
-
-//			GPIO_WriteBit(GPIOB, GPIO_Pin_1, 0);
-		}
-
+		//look for commands from the host, replies go out with the next frame
+		commandService();
+		//send whatever is waiting for the uart, or due
+		outputService(analogValues);
+		//process and send each block of audio as it fills up
+		acquireService();
 	}
 }
 
@@ -67,7 +44,7 @@ void initRcc() {
 	//enable adc, dma, uart, i2c, and gpio clocks
 	RCC->AHBENR |= RCC_AHBENR_GPIOAEN | RCC_AHBENR_GPIOBEN | RCC_AHBENR_DMAEN;
 	RCC->APB1ENR |= RCC_APB1ENR_I2C1EN;
-	RCC->APB2ENR |= RCC_APB2ENR_ADC1EN | RCC_APB2ENR_TIM1EN | RCC_APB2ENR_USART1EN;
+	RCC->APB2ENR |= RCC_APB2ENR_ADC1EN | RCC_APB2ENR_TIM1EN | RCC_APB2ENR_USART1EN | RCC_APB2ENR_SYSCFGEN;
 
 	//Start HSI14 RC oscillator for the ADC and wait for it
 	RCC->CR2 |= RCC_CR2_HSI14ON;
@@ -78,7 +55,7 @@ void initRcc() {
 void initTim1() {
 	TIM1->CR2 |= TIM_CR2_MMS_1 | TIM_CR2_MMS_0; //output compare pulse - magic trigger needed for ADC
 	TIM1->CR1 |= TIM_CR1_CEN | TIM_CR1_ARPE; // enable and auto-reload
-	TIM1->ARR = 2399; //48mhz / 2400 = 20khz
+	TIM1->ARR = SystemCoreClock / AUDIO_SAMPLE_RATE - 1; //48mhz / 2400 = 20khz by default
 
 	//Generate an update event to reload the Prescaler and the repetition countervalue immediately
 	TIM1->EGR = TIM_EGR_UG;
@@ -96,11 +73,11 @@ void initAdc() {
 	//set ADC_CFGR1_DMAEN = 1 to enable dma
 	ADC1->CFGR1 = ADC_CFGR1_DMACFG | ADC_CFGR1_DMAEN | ADC_CFGR1_EXTEN_0;
 
-	//set ADC_SMPR = 101 for 55cycle sample time
-	ADC1->SMPR = 0b101;
-	//set ADC_CHSELR bits to enable various channels (0, 1, 4, 5, 6, 7, 8)
-	ADC1->CHSELR = ADC_CHSELR_CHSEL0 | ADC_CHSELR_CHSEL1 | ADC_CHSELR_CHSEL4 |
-					ADC_CHSELR_CHSEL5 | ADC_CHSELR_CHSEL6 | ADC_CHSELR_CHSEL7 | ADC_CHSELR_CHSEL9;
+	//set ADC_SMPR = 110 for 71.5cycle sample time
+	//with only 2 conversions per trigger there's time to spare, (71.5 + 12.5) / 14MHz = 6us each
+	ADC1->SMPR = 0b110;
+	//set ADC_CHSELR bits for audio (0) and the first slow channel, the DMA interrupt rotates through the rest
+	ADC1->CHSELR = ADC_CHSELR_CHSEL0 | analogChannels[0];
 	//set ADC_ADEN to enable adc and wait for ready
 	ADC1->CR |= ADC_CR_ADEN;
 	while (!(ADC1->ISR & ADC_ISR_ADRDY))
@@ -126,18 +103,29 @@ void initGpio() {
 }
 
 void initUart() {
-	USART1->BRR = 0x1A1; // example from manual for 115200 @ 48mhz
-	//enable tx, and uart, leave everything else 0 for 8N1
-	USART1->CR1 = USART_CR1_TE | USART_CR1_UE;
-	//enable DMA for transmits
-	USART1->CR3 |= USART_CR3_DMAT;
+	USART1->BRR = (SystemCoreClock + UART_BAUD / 2) / UART_BAUD; //0x1A1 for 115200 @ 48mhz
+	//enable tx, rx, and uart, leave everything else 0 for 8N1
+	USART1->CR1 = USART_CR1_TE | USART_CR1_RE | USART_CR1_UE;
+	//enable DMA for transmits and receives, and don't let an overrun stop receiving
+	USART1->CR3 |= USART_CR3_DMAT | USART_CR3_DMAR | USART_CR3_OVRDIS;
+
+	//USART1 RX normally shares DMA channel 3 with I2C, move it to channel 5
+	SYSCFG->CFGR1 |= SYSCFG_CFGR1_USART1RX_DMA_RMP;
+	DMA1_Channel5->CPAR = (uint32_t) &USART1->RDR;
+	DMA1_Channel5->CMAR = (uint32_t) rxBuffer;
+	DMA1_Channel5->CNDTR = USART_RX_SIZE;
+	//set DMA_CCR_CIRC (circular) mode and DMA_CCR_MINC to increment memory address
+	//the main loop checks in, the half and full interrupts only count how much has come in, see usartRead()
+	DMA1_Channel5->CCR = DMA_CCR_CIRC | DMA_CCR_MINC | DMA_CCR_HTIE | DMA_CCR_TCIE | DMA_CCR_EN;
+	NVIC_SetPriority(DMA1_Channel4_5_IRQn, 3);
+	NVIC_EnableIRQ(DMA1_Channel4_5_IRQn);
 }
 
 void initDma() {
 	//configure DMA to read from ADC into a buffer
 	DMA1_Channel1->CPAR = (uint32_t) (&(ADC1->DR)); //point dma to ADC data reg
 	DMA1_Channel1->CMAR = (uint32_t) (adcBuffer); //point DMA to buffer memory
-	DMA1_Channel1->CNDTR = 7; //count of transfers per circle
+	DMA1_Channel1->CNDTR = 2; //count of transfers per circle
 	//enable DMA_CCR_CIRC (circular) mode (so addresses reset when its done)
 	//set DMA_CCR_MINC to incrememnt memory address
 	//set DMA_CCR_MSIZE = 01 for 16 bit xfers to memory
@@ -151,31 +139,17 @@ void initDma() {
 
 	//NOTE DMA channel2 is used on the fly by sendOutBuffer()
 
-	//configure DMA to read from ADC into a buffer
+	//configure DMA to read from I2C, the buffer and count are set for each read by i2cStartDmaRead()
 	DMA1_Channel3->CPAR = (uint32_t) (&(I2C1->RXDR)); //point dma to rx data reg
-	DMA1_Channel3->CMAR = (uint32_t) (&accelerometer[0]); //point DMA to buffer memory
-	DMA1_Channel3->CNDTR = 6; //count of transfers per circle
-	//enable DMA_CCR_CIRC (circular) mode (so addresses reset when its done)
 	//set DMA_CCR_MINC to incrememnt memory address
 	//set DMA_CCR_TCIE for transfer complete interrupt
-	DMA1_Channel3->CCR |= DMA_CCR_CIRC | DMA_CCR_MINC | DMA_CCR_TCIE;
-	DMA1_Channel3->CCR |= DMA_CCR_EN; //enable channel 1 dma
+	DMA1_Channel3->CCR |= DMA_CCR_MINC | DMA_CCR_TCIE;
 
 	NVIC_EnableIRQ(DMA1_Channel2_3_IRQn);
 	NVIC_SetPriority(DMA1_Channel2_3_IRQn, 0);
 
 }
 
-void initI2C() {
-	I2C1->TIMINGR = (uint32_t) 0x0000020B; //magic value from cubemx for 400khz
-	//enable the module and interrupts for any error condition
-	I2C1->CR1 = I2C_CR1_PE | I2C_CR1_ERRIE | I2C_CR1_STOPIE | I2C_CR1_NACKIE | I2C_CR1_RXDMAEN;
-
-	NVIC_EnableIRQ(I2C1_IRQn);
-	NVIC_SetPriority(I2C1_IRQn, 4);
-}
-
-
 void writeToUsart(uint8_t * outBuffer, uint32_t len) {
 	DMA1_Channel2->CCR = 0; //disable, reset state
 	DMA1_Channel2->CPAR = (uint32_t) &USART1->TDR;
@@ -187,190 +161,183 @@ void writeToUsart(uint8_t * outBuffer, uint32_t len) {
 	DMA1_Channel2->CCR = DMA_CCR_MINC | DMA_CCR_DIR | DMA_CCR_EN;
 }
 
-//write a single value to a register. Slow, blocking, but usually only used during startup
-//TODO could be more resilient to transient i2c errors. If things go really sideways this will just block forever
-void i2cWriteReg(uint8_t addr, uint8_t reg, uint8_t value) {
-	while (I2C1->ISR & I2C_ISR_BUSY)
-		;
-	//initiate start, send out slave address
-	I2C_TransferHandling(I2C1, addr, 2, I2C_SoftEnd_Mode, I2C_Generate_Start_Write);
-	//wait for TXIS
-	while (I2C_GetFlagStatus(I2C1, I2C_ISR_TXIS) == 0)
-		;
-	//write out register address of interest
-	I2C_SendData(I2C1, reg);
-	while (I2C_GetFlagStatus(I2C1, I2C_ISR_TXIS) == 0)
-		;
-	I2C_SendData(I2C1, value);
-	//wait for TC
-	while (I2C_GetFlagStatus(I2C1, I2C_ISR_TC) == 0)
-		;
-	I2C_GenerateSTOP(I2C1, ENABLE);
+//nothing left in the DMA and the last byte has finished shifting out
+bool usartIdle() {
+	return DMA1_Channel2->CNDTR == 0 && (USART1->ISR & USART_ISR_TC);
 }
 
-void i2cReadReg(uint8_t addr, uint8_t reg, uint8_t * value, uint8_t len) {
-	while (I2C1->ISR & I2C_ISR_BUSY)
-		;
-	//initiate start, send out slave address
-	I2C_TransferHandling(I2C1, addr, 1, I2C_SoftEnd_Mode, I2C_Generate_Start_Write);
-	//wait for TXIS
-	while (I2C_GetFlagStatus(I2C1, I2C_ISR_TXIS) == 0)
-		;
-	//write out register address of interest
-	I2C_SendData(I2C1, reg | 0x80);
-	//wait for TC
-	while (I2C_GetFlagStatus(I2C1, I2C_ISR_TC) == 0)
-		;
-	I2C_TransferHandling(I2C1, LIS3DH_ADDR, len, I2C_AutoEnd_Mode, I2C_Generate_Start_Read);
-
-	for (int i = 0; i < len; i++) {
-		//wait for RXNE
-		while (I2C_GetFlagStatus(I2C1, I2C_ISR_RXNE) == 0)
-			;
-		value[i] = I2C_ReceiveData(I2C1);
+//takes the next byte the host sent, false if nothing new has come in
+bool usartRead(uint8_t * c) {
+	//bytes written so far, the halves counted plus how far into the next one the DMA is
+	//if it's just crossed into another half and the interrupt hasn't run yet, that's half a buffer more
+	uint32_t halves, pos;
+	do {
+		halves = rxHalves;
+		pos = USART_RX_SIZE - DMA1_Channel5->CNDTR;
+	} while (halves != rxHalves);
+	uint32_t written = halves * (USART_RX_SIZE / 2) + ((pos - (halves & 1) * (USART_RX_SIZE / 2)) & (USART_RX_SIZE - 1));
+	if (written - rxRead > USART_RX_SIZE) {
+		//the DMA went all the way round onto bytes that weren't read yet, keep what's left of the newest
+		usartOverruns++;
+		rxRead = written - USART_RX_SIZE;
 	}
-
-	while (I2C1->ISR & I2C_ISR_BUSY)
-		;
+	if (rxRead == written)
+		return false;
+	*c = rxBuffer[rxRead & (USART_RX_SIZE - 1)];
+	rxRead++;
+	return true;
 }
 
-void initAccelerometer() {
-	I2C1->CR1 = I2C_CR1_PE | I2C_CR1_ERRIE | I2C_CR1_STOPIE | I2C_CR1_NACKIE | I2C_CR1_RXDMAEN;
-	//configure registers for desired mode
-	//set CTRL_REG1(20h) - ODR 100hz = 0101 | lpen off = 0 | xzy enable = 111
-	i2cWriteReg(LIS3DH_ADDR, 0x20, 0b01010111);
-	//set CTRL_REG4(23h) - BDU continuous = 1 | BLE big = 0 | FS 16g = 11 | HR high = 1 | ST off = 00 | SIM x = 0
-	i2cWriteReg(LIS3DH_ADDR, 0x23, 0b10111000);
-	I2CMode = IDLE;
+void usartSetBaud(uint32_t baud) {
+	//can only change it while the uart is off
+	USART1->CR1 &= ~USART_CR1_UE;
+	USART1->BRR = (SystemCoreClock + baud / 2) / baud;
+	USART1->CR1 |= USART_CR1_UE;
 }
 
-//start poll sequence by initiating a start and sending the slave address
-void startAccelerometerPoll() {
-	//check to see if things are in the right state for this, or make it so
-	//maybe something went wrong, and we can reset things back to normal.
-	if (I2CMode == IDLE) {
-		I2C_TransferHandling(I2C1, LIS3DH_ADDR, 1, I2C_SoftEnd_Mode, I2C_Generate_Start_Write);
-		I2CMode = STARTING;
-		I2C1->CR1 |= I2C_CR1_TXIE; //listen for TXIS, indicating that we can start writing
-	} else {
-		I2CMode = NEEDSRESET;
-	}
-}
+//I2C on the registers, i2c.c decides what to do next from the events these end up sending
+#define I2C_CR1_RUNNING (I2C_CR1_PE | I2C_CR1_ERRIE | I2C_CR1_STOPIE | I2C_CR1_NACKIE | I2C_CR1_RXDMAEN)
+static bool i2cAutoEnd; //whether the write going out stops at the end, or waits on TC to carry on with a read
 
+void initI2C() {
+	I2C1->TIMINGR = (uint32_t) 0x0000020B; //magic value from cubemx for 400khz
+	//enable the module and interrupts for any error condition
+	I2C1->CR1 = I2C_CR1_RUNNING;
 
-void SysTick_Handler(void) {
-	//keep track of milliseconds
-	ms++;
+	NVIC_EnableIRQ(I2C1_IRQn);
+	NVIC_SetPriority(I2C1_IRQn, 4);
 }
 
-//handle DMA for the channel doing ADC
-void DMA1_CH1_IRQHandler() {
-	if (DMA1->ISR & DMA_ISR_TCIF1) {
-		//the dma transfer is complete
-		int16_t audioSample = adcBuffer[0]<<3;
-
-
-		//downsample 50:1 for the low frequency buffer
-		bufferLowHz.avg += audioSample;
-		if (++bufferLowHz.downSampleCounter >= 50) {
-			bufferLowHz.downSampleCounter = 0;
-			bufferLowHz.circular[bufferLowHz.head++] = bufferLowHz.avg/50 - (audioAverage>>16);
-			bufferLowHz.avg = 0;
-			if (bufferLowHz.head >= 32)
-				bufferLowHz.head = 0;
-		}
-
-		volatile int32_t d = (audioSample<<16) - audioAverage;
-		audioAverage += (d) >> 16;
-		audioSample -= audioAverage>>16;
-
-
-		//save to the ping-pong buffer
-		buffer[readSide][readPos] = audioSample;
-
-		readPos++;
-		if (readPos >= HIGH_N) {
-			//copy the 400 hz buffer snapshot
-			for (int i = 0; i < LOW_N; i++) {
-				bufferLowHz.output[i] = bufferLowHz.circular[(bufferLowHz.head + i) & 31];
-			}
-			//toggle sides and mark done
-			readSide = !readSide;
-			readPos = 0;
-			readDone = true;
-		}
-	}
+//start and send the slave address, then TXIS asks for each byte
+void i2cBusWrite(uint8_t addr, int len, bool stop) {
+	i2cAutoEnd = stop;
+	I2C_TransferHandling(I2C1, addr, len, stop ? I2C_AutoEnd_Mode : I2C_SoftEnd_Mode, I2C_Generate_Start_Write);
+	I2C1->CR1 |= I2C_CR1_TXIE; //listen for TXIS, indicating that we can start writing
+}
 
-	//is this bad? this seems right, but also wrong somehow
-	//unset any set bits for channel1
-	DMA1->IFCR = DMA1->ISR & 0xf;
+void i2cBusSend(uint8_t data, bool last) {
+	I2C_SendData(I2C1, data);
+	if (last) {
+		I2C1->CR1 &= ~I2C_CR1_TXIE; //ignore TXIS for now
+		if (!i2cAutoEnd)
+			I2C1->CR1 |= I2C_CR1_TCIE; //listen for TC
+	}
 }
 
+//restart and read with DMA, the stop goes out on its own after the last byte
+void i2cBusRead(uint8_t addr, void * dest, int len) {
+	DMA1_Channel3->CCR &= ~DMA_CCR_EN; //can only change these while disabled
+	DMA1_Channel3->CMAR = (uint32_t) dest;
+	DMA1_Channel3->CNDTR = len;
+	DMA1_Channel3->CCR |= DMA_CCR_EN;
+	I2C_TransferHandling(I2C1, addr, len, I2C_AutoEnd_Mode, I2C_Generate_Start_Read);
+	I2C1->CR1 &= ~I2C_CR1_TCIE; //ignore TC for now, waiting for DMA
+}
 
-void I2C1_ErrorHandler() {
-	I2CMode = NEEDSRESET;
-	I2C_GenerateSTOP(I2C1, ENABLE);
+//turning PE off resets the peripheral's state machine and lets go of the bus
+void i2cBusOff() {
+	I2C1->CR1 = 0;
+	DMA1_Channel3->CCR &= ~DMA_CCR_EN;
 }
 
-void I2C1_IRQHandler() {
-	if (I2C1->ISR & (I2C_ISR_NACKF | I2C_ISR_ARLO | I2C_ISR_BERR)) {
-		I2C1_ErrorHandler();
-	} else {
-		switch (I2CMode) {
-		case STARTING:
-			//expect I2C_ISR_TXIS
-			if (!(I2C1->ISR & I2C_ISR_TXIS)) {
-				I2C1_ErrorHandler();
-				break;
-			}
-			I2CMode = SENDING_REG;
-			I2C_SendData(I2C1, 0x28 | 0x80); //start at OUT_X_L and set MSB to increment per read
-			I2C1->CR1 &= ~I2C_CR1_TXIE; //ignore TXIS for now
-			I2C1->CR1 |= I2C_CR1_TCIE; //listen for TC
+static void i2cDelay() {
+	//at least 5us, half a clock at 100khz. cycleCount() can't be used since ms doesn't tick while in SysTick
+	for (volatile int i = 0; i < SystemCoreClock / 1000000; i++)
+		;
+}
 
-			break;
-		case SENDING_REG:
-			//expect I2C_ISR_TC
-			if (!(I2C1->ISR & I2C_ISR_TC)) {
-				I2C1_ErrorHandler();
-				break;
-			}
-			I2CMode = READING;
-			I2C_TransferHandling(I2C1, LIS3DH_ADDR, 6, I2C_AutoEnd_Mode, I2C_Generate_Start_Read);
-			I2C1->CR1 &= ~I2C_CR1_TCIE; //ignore TC for now, waiting for DMA
-			break;
-		case READING:
-			//DMA is handling the reads, so if we get here there's probably an error
-			I2C1_ErrorHandler();
-			break;
-		case STOPPING:
-			//expect I2C_ISR_STOPF
-			if (!(I2C1->ISR & I2C_ISR_STOPF)) {
-				I2C1_ErrorHandler();
-				return;
-			}
-			I2CMode = IDLE;
-			break;
-		case IDLE:
-			//don't care really
-			break;
-		case NEEDSRESET:
-			//can't do much here
-			break;
-		}
+//a slave that was cut off mid read can be left holding SDA low waiting for more clocks
+//take over the pins and clock SCL until it lets go, then put a stop on the bus. about 100us worst case
+//then turn the peripheral back on
+void i2cBusRecover() {
+	GPIOA->BSRR = GPIO_BSRR_BS_9 | GPIO_BSRR_BS_10;
+	GPIOA->OTYPER |= GPIO_OTYPER_OT_9 | GPIO_OTYPER_OT_10;
+	GPIOA->MODER = (GPIOA->MODER & ~(GPIO_MODER_MODER9 | GPIO_MODER_MODER10)) | GPIO_MODER_MODER9_0 | GPIO_MODER_MODER10_0;
+	i2cDelay();
+	for (int i = 0; i < 9 && !(GPIOA->IDR & GPIO_IDR_10); i++) {
+		GPIOA->BRR = GPIO_BRR_BR_9;
+		i2cDelay();
+		GPIOA->BSRR = GPIO_BSRR_BS_9;
+		i2cDelay();
 	}
+	//stop is SDA going high while SCL is high
+	GPIOA->BRR = GPIO_BRR_BR_10;
+	i2cDelay();
+	GPIOA->BSRR = GPIO_BSRR_BS_10;
+	i2cDelay();
+	//hand the pins back to the I2C peripheral
+	GPIOA->MODER = (GPIOA->MODER & ~(GPIO_MODER_MODER9 | GPIO_MODER_MODER10)) | GPIO_MODER_MODER9_1 | GPIO_MODER_MODER10_1;
+	GPIOA->OTYPER &= ~(GPIO_OTYPER_OT_9 | GPIO_OTYPER_OT_10);
+	I2C1->CR1 = I2C_CR1_RUNNING;
+}
 
-	I2C1->ICR = I2C1->ISR; //is this bad? this seems right, but also wrong somehow
+void I2C1_IRQHandler() {
+	uint32_t isr = I2C1->ISR;
+	//clear first, the callback at the end of a transaction can start the next one from in here
+	I2C1->ICR = isr; //is this bad? this seems right, but also wrong somehow
+	if (isr & (I2C_ISR_NACKF | I2C_ISR_ARLO | I2C_ISR_BERR))
+		i2cEvent(I2C_EVENT_ERROR);
+	else if (isr & I2C_ISR_STOPF)
+		i2cEvent(I2C_EVENT_STOP);
+	else if (isr & I2C_ISR_TC)
+		i2cEvent(I2C_EVENT_TX_DONE);
+	else if (isr & I2C_ISR_TXIS)
+		i2cEvent(I2C_EVENT_TX_READY);
+}
+
+//handle DMA for the channel receiving from the host, each half of rxBuffer filled is counted for usartRead()
+void DMA1_CH4_5_IRQHandler() {
+	uint32_t isr = DMA1->ISR;
+	rxHalves += !!(isr & DMA_ISR_HTIF5) + !!(isr & DMA_ISR_TCIF5);
+	DMA1->IFCR = DMA_IFCR_CGIF5;
 }
 
 //handle DMA for the channel doing I2C
 void DMA1_CH2_3_IRQHandler() {
 	if (DMA1->ISR & DMA_ISR_TCIF3) {
-		//i2c transfer complete
-		I2CMode = STOPPING;
+		//i2c read complete
+		i2cEvent(I2C_EVENT_RX_DONE);
 	}
 	//is this bad? this seems right, but also wrong somehow
 	//unset any set bits for channel3
 	DMA1->IFCR = DMA1->ISR & 0xf00;
 }
 
+void SysTick_Handler(void) {
+	//keep track of milliseconds
+	ms++;
+	//the accelerometer runs on its own schedule from here, the main loop never touches I2C
+	i2cService();
+	accelerometerService();
+}
+
+//cycles since startup from the ms count and the SysTick down counter, wraps every ~89 seconds
+//not exact if SysTick reloads just as this is called, but good enough for profiling
+uint32_t cycleCount() {
+	uint32_t t, val;
+	do {
+		t = ms;
+		val = SysTick->VAL;
+	} while (t != ms);
+	return t * (SystemCoreClock / 1000) + (SysTick->LOAD - val);
+}
+
+//handle DMA for the channel doing ADC
+void DMA1_CH1_IRQHandler() {
+	if (DMA1->ISR & DMA_ISR_TCIF1) {
+		//the dma transfer is complete, audio and whichever slow channel rode along
+		int slot = acquireSample(adcBuffer[0], adcBuffer[1]);
+
+		//the channel selection can only change while stopped. the sequence is done and waiting for the
+		//next trigger, so this only takes a moment
+		ADC1->CR |= ADC_CR_ADSTP;
+		while (ADC1->CR & ADC_CR_ADSTP)
+			;
+		ADC1->CHSELR = ADC_CHSELR_CHSEL0 | analogChannels[slot];
+		ADC1->CR |= ADC_CR_ADSTART;
+	}
+
+	//is this bad? this seems right, but also wrong somehow
+	//unset any set bits for channel1
+	DMA1->IFCR = DMA1->ISR & 0xf;
+}
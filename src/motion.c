@@ -0,0 +1,143 @@
+#include "main.h"
+#include "repeat.h"
+
+//atan(i/64) for the first octant, 8192 = 45 degrees. generated by the compiler
+#define ATAN_ENTRY(i) (uint16_t) __builtin_round(__builtin_atan((i) / 64.0) * 8192 / __builtin_atan(1.0)),
+static const uint16_t atanTable[65] = {
+		REPEAT(64, ATAN_ENTRY, 0) ATAN_ENTRY(64)
+};
+
+/*
+ * Fixed point atan2 from the table above with linear interpolation, good to about 0.01 degrees
+ * returns -32768 to 32767 for -180 to 180 degrees. inputs need to fit in 17 bits
+ */
+int16_t fixAtan2(int32_t y, int32_t x) {
+	uint32_t ay = abs(y), ax = abs(x);
+	if (ax == 0 && ay == 0)
+		return 0;
+	//work out the angle in the first octant, then mirror it out to the right one
+	bool steep = ay > ax;
+	uint32_t r = steep ? (ax << 14) / ay : (ay << 14) / ax; //0-16384
+	int i = r >> 8, frac = r & 0xff;
+	int32_t a = atanTable[i];
+	if (frac)
+		a += ((atanTable[i + 1] - a) * frac) >> 8;
+	if (steep)
+		a = 16384 - a;
+	if (x < 0)
+		a = 32768 - a;
+	return y < 0 ? -a : a;
+}
+
+//per frame summary of the samples read out of the accelerometer FIFO
+AccelStats accelStats;
+
+static void motionEvent(int event) {
+	accelStats.events |= 1 << event;
+	accelStats.eventMs[event] = ms;
+}
+
+/*
+ * Summarize a burst of samples from the accelerometer FIFO, called from the I2C interrupt once a burst is in
+ * samples are raw left justified 12 bit values, count is at least 1, the last one arrived around newestMs
+ */
+void accelerometerProcessFifo(int16_t samples[][3], int count, uint32_t newestMs) {
+	static int16_t last[3]; //carries over from the previous burst so jerk doesn't miss the boundary
+	int32_t sum[3] = {0};
+	uint16_t peak[3] = {0};
+	uint16_t jerk = 0;
+
+	for (int i = 0; i < count; i++) {
+		uint16_t change = 0;
+		for (int axis = 0; axis < 3; axis++) {
+			int16_t v = samples[i][axis];
+			sum[axis] += v;
+			uint16_t a = abs(v);
+			peak[axis] = a > peak[axis] ? a : peak[axis];
+			change += abs(v - last[axis]) >> 2;
+			last[axis] = v;
+		}
+		jerk = change > jerk ? change : jerk;
+	}
+
+	int16_t mean[3];
+	for (int axis = 0; axis < 3; axis++) {
+		mean[axis] = sum[axis] / count;
+	}
+
+	//rms of the movement around the mean, in 12 bits so the squares can't overflow
+	uint32_t sumSquares = 0;
+	for (int i = 0; i < count; i++) {
+		for (int axis = 0; axis < 3; axis++) {
+			int32_t d = (samples[i][axis] - mean[axis]) >> 4;
+			sumSquares += d * d;
+		}
+	}
+	uint32_t meanSquare = sumSquares / count;
+	//fix16_sqrt of a plain integer comes back 256x, keep 16x of that to undo the >>4 above
+	uint32_t rms = fix16_sqrt(meanSquare) >> 4;
+
+	//polls don't line up with frames, so merge into everything since the last frame went out
+	//processSensorData() takes the stats and sets samples back to 0
+	static uint32_t frameMeanSquare;
+	int n = accelStats.samples;
+	int frameSamples = n + count;
+	for (int axis = 0; axis < 3; axis++) {
+		accelStats.mean[axis] = ((int32_t) accelStats.mean[axis] * n + sum[axis]) / frameSamples;
+		accelStats.peak[axis] = n && accelStats.peak[axis] > peak[axis] ? accelStats.peak[axis] : peak[axis];
+	}
+	accelStats.jerk = n && accelStats.jerk > jerk ? accelStats.jerk : jerk;
+	//close enough, this ignores the mean moving between bursts
+	frameMeanSquare = ((uint64_t) frameMeanSquare * n + (uint64_t) meanSquare * count) / frameSamples;
+	uint32_t frameRms = fix16_sqrt(frameMeanSquare) >> 4;
+	accelStats.rms = frameRms > 0xffff ? 0xffff : frameRms;
+	accelStats.samples = frameSamples > 0xffff ? 0xffff : frameSamples;
+	accelStats.sampleMs = newestMs;
+
+	//shake is the rms of each poll smoothed over 8 polls, with hysteresis so one long shake is one event
+	static uint32_t shakeSum;
+	static bool shaking;
+	shakeSum += (rms > 0xffff ? 0xffff : rms) - (shakeSum >> 3);
+	accelStats.shake = shakeSum >> 3;
+	if (!shaking && accelStats.shake > settings.shakeMg * ACCEL_1G / 1000) {
+		shaking = true;
+		motionEvent(MOTION_SHAKE);
+	} else if (accelStats.shake < settings.shakeMg * ACCEL_1G / 2000) {
+		shaking = false;
+	}
+
+	//tilt, using 12 bits so the squares fit
+	int32_t x = mean[0] >> 4, y = mean[1] >> 4, z = mean[2] >> 4;
+	accelStats.pitch = fixAtan2(x, fix16_sqrt(y * y + z * z) >> 8);
+	accelStats.roll = fixAtan2(y, z);
+
+	//6D orientation, an axis takes over once it's within 30 degrees of vertical (its square is 3x the others)
+	//in between, the last orientation sticks
+	int32_t sq[3] = {x * x, y * y, z * z};
+	int32_t total = sq[0] + sq[1] + sq[2];
+	for (int axis = 0; axis < 3; axis++) {
+		if (sq[axis] * 4 > total * 3) {
+			uint8_t orientation = axis * 2 + (mean[axis] < 0);
+			if (orientation != accelStats.orientation) {
+				accelStats.orientation = orientation;
+				motionEvent(MOTION_ORIENTATION);
+			}
+		}
+	}
+}
+
+/*
+ * Check the latched INT1_SRC and CLICK_SRC registers from the accelerometer
+ * these latch until read, so anything the accelerometer saw between polls gets counted
+ */
+void accelerometerProcessSources(uint8_t int1Src, uint8_t clickSrc) {
+	//IA is set if anything happened
+	if (int1Src & 0x40)
+		motionEvent(MOTION_FREEFALL);
+	if (clickSrc & 0x40) {
+		if (clickSrc & 0x10)
+			motionEvent(MOTION_TAP);
+		if (clickSrc & 0x20)
+			motionEvent(MOTION_DOUBLE_TAP);
+	}
+}
@@ -1,99 +1,227 @@
 
 #include "main.h"
 
-//an fft of 512 gives us 256 buckets of frequency info. at 20khz, each has ~38Hz
+//an fft of 512 gives us 256 buckets of frequency info. at 20khz, each has ~39Hz
 //we don't really want all 256 buckets of frequency info
 //if we compressed this linearly, we'd lose a lot of low/mid tone info
 //also, in order to capture low frequency stuff below 38Hz would require a much larger fft
 //so we can combine a downsampled 400hz using a smaller fft for low frequency stuff with the 20khz stuff
+//AUDIO_SAMPLE_RATE can be changed, the 400hz stuff stays the same and the high frequency buckets follow along
 
-//the first 6 buckets are dedicated to low frequency audio from 12.5-162.5 Hz
-const uint8_t lowFrequencyMap[6] = {
-		3, 4, 6, 8, 10, 13
-};
-//the next 26 buckets are dedicated to higher frequency audio from 195Hz to just under the nyquist limit of 10khz
-const uint8_t highFrequencyMap[26] = {
-		5, 6, 8, 10, 12, 15, 18, 22, 25, 30, 35, 40, 46, 53, 61, 70, 80, 92, 105, 119, 136, 154, 175, 199, 225, 255,
-};
+//the band layout is in settings.c
 
+#ifdef PROFILE_FFT
+//cycles taken by the last low and high frequency fix_fft calls, have a look with the debugger
+uint32_t fftCycles[2];
+#endif
 
-char outBuffer[100];
+char outBuffer[OUT_BUFFER_SIZE];
 int outBufferLen;
+static bool outPending; //outBuffer is waiting for the uart to finish with a smaller frame
+static bool outSending; //the uart is (or was last) sending outBuffer, rather than a small frame
+//after the main frame, outBuffer takes the motion frame and then any reply to a command in turn
+static bool motionPending;
+static bool replyPending;
+uint16_t outputDropped; //blocks that weren't sent because the uart was still busy with the last frame
 
 #define WRITEOUT(v) {memcpy(out, &v, sizeof(v)); out+= sizeof(v);}
 
+//with FRAMING_COBS each frame is COBS encoded, so a 0 only ever shows up between frames and a receiver
+//that lost its place picks up again at the next one. the 0 takes the place of "END", so it costs nothing
+//a frame is written with a spare byte in front for the encoding, which then happens in place once it's done
+_Static_assert(6 + 3 + COMPRESS_MAX_FIELDS * 2 < 254, "frames have to stay under 254 bytes to encode in place");
+
+//starts a frame at out, returns where its header goes
+static char * frameBegin(char * out) {
+	return settings.framing == FRAMING_COBS ? out + 1 : out;
+}
+
+/*
+ * Ends the frame with its header at start, written up to end. returns the new end
+ * COBS replaces each 0 with the distance to the next one, the first distance goes in the spare byte
+ * and the last points at the 0 that ends the frame
+ */
+static char * frameEnd(char * start, char * end) {
+	if (settings.framing != FRAMING_COBS) {
+		memcpy(end, "END", 4);
+		return end + 4;
+	}
+	char * next = end;
+	for (char * p = end - 1; p >= start; p--) {
+		if (*p == 0) {
+			*p = next - p;
+			next = p;
+		}
+	}
+	start[-1] = next - (start - 1);
+	*end = 0;
+	return end + 1;
+}
+
+//dc blocking high pass, the dc level is tracked with a one pole low pass and subtracted
+//k is 2*pi*corner/rate with 16 bits of fraction, and the level keeps 16 bits of fraction too
+//so even low corners settle exactly to 0 instead of stalling a few lsb out
+#define DC_BLOCK_K ((int32_t) (6.283185307179586 * DC_BLOCK_CORNER_HZ * 65536 / AUDIO_SAMPLE_RATE + 0.5))
+static int32_t dcLevel = 16384 << 16; //ADC mid scale, as shifted up by the ISR
+
+/*
+ * Removes dc from a block of raw audio, in time order and carrying the filter state from block to block
+ * in is in FFT_SLOT order
+ * y[n] = x[n] - dc[n-1], dc[n] = dc[n-1] + k * (x[n] - dc[n-1])
+ */
+void dcBlock(int16_t * in, int m) {
+	int n = 1 << m;
+	int32_t dc = dcLevel;
+	for (int i = 0; i < n; i++) {
+		int16_t * s = &in[FFT_SLOT(i, m)];
+		int32_t x = *s;
+		*s = x - ((dc + 0x8000) >> 16);
+		//16x16 bit multiply of the error in two halves, keeps it all in 32 bits
+		int32_t err = (x << 16) - dc;
+		dc += (err >> 16) * DC_BLOCK_K + (((err & 0xffff) * DC_BLOCK_K) >> 16);
+	}
+	dcLevel = dc;
+}
+
+//saturating bin magnitude, multiplied by 16
+static inline uint16_t binMagnitude(int32_t re, int32_t im) {
+	uint32_t ur = abs(re), ui = abs(im);
+	//anything past 4096 saturates anyway, so bail before the squares can overflow
+	if (ur >= 4096 || ui >= 4096)
+		return 0xffff;
+	//using the fix16_sqrt gives us a bit more resolution as we get
+	//8 bits more using this over an integer sqrt
+	int32_t t = fix16_sqrt(ur * ur + ui * ui);
+
+	//we can't keep all those extra bits, but 4 of 8 seems like a good value
+	//as this only overloads a little and only for REALLY LOUD inputs
+	t >>= 4;
+	if (t > 0xffff)
+		t = 0xffff;
+	return t;
+}
+
 /*
- * Takes a real input, applies Hann window, calculates energyAverage
- * out must be the the same size as in as it is used for the imaginary part
- * after returning, the first half is filled with bucket magnitudes
+ * Takes a real input, applies a window, calculates energyAverage
+ * window is one of the half tables from window.c for this size
+ * in must be stored deinterleaved (see FFT_SLOT), evens in the first half and odds in the second
+ * the fft runs in place and the bucket magnitudes are written back over the first half of in,
+ * which is returned for convenience
  * magnitude is multiplied by 16 and saturates at 16 bits
  * m = log2(n)
  */
-void fftRealWindowedMagnitude(int16_t * in, uint16_t * out, int m, uint16_t * energyAverage) {
-	int16_t * imag = (int16_t *) out; //borrow out for imaginary part
+uint16_t * fftRealWindowedMagnitude(int16_t * in, int m, const int16_t * window, uint16_t * energyAverage) {
 	int n = 1 << m;
+	int halfN = n >> 1;
+	int16_t * re = in;
+	int16_t * im = in + halfN;
+	uint16_t * out = (uint16_t *) in;
 
-	//init with zeros
-	for (int i = 0; i < n; i++) {
-		imag[i] = 0;
-	}
 	uint32_t energyTotal = 0;
 	for (int i = 0; i < n; i++) {
-		energyTotal += abs(in[i]);
+		int16_t * s = &in[FFT_SLOT(i, m)];
+		energyTotal += abs(*s);
 
-		//apply the hann windowing function, borrowing Sinewave LUT from fix_fft
-		//the positive portion of Sinewave ranges from index 0-512
-		// (i * 512) / n  == (i * 512) >> m
-		int si = (i * 512) >> m ;
-		in[i] = (Sinewave[si] * in[i]) >> 16;
+		//apply the window, mirrored for the second half
+		int16_t w = window[i <= halfN ? i : n - i];
+		*s = (w * *s) >> 16;
 	}
 	*energyAverage = energyTotal >> m;
 
-	//run the FFT (runs in place, overwriting both in and imag)
-	fix_fft(in, imag, m, 0);
+	//the evens and odds make a complex signal of half the size, so the fft
+	//runs at half the size and without needing any scratch for the imaginary part
+#ifdef PROFILE_FFT
+	uint32_t start = cycleCount();
+#endif
+	fix_fft(re, im, m - 1, 0);
+#ifdef PROFILE_FFT
+	fftCycles[m == HIGH_NLOG2] = cycleCount() - start;
+#endif
 
-	//calculate the magnitude and store in out for only the first half
-	int halfN = n>>1;
-	for (int i = 0; i < halfN; i++) {
-		//using the fix16_sqrt gives us a bit more resolution as we get
-		//8 bits more using this over an integer sqrt
-		int32_t t = fix16_sqrt(imag[i] * imag[i] + in[i] * in[i]);
+	//untangle the spectrum of the real input from the half size complex result
+	//bins k and halfN-k depend on the same pair of complex values, so each pair is
+	//finished before its magnitudes are written back over the real part
+	for (int k = 0; k <= halfN / 2; k++) {
+		int nk = (halfN - k) & (halfN - 1);
+		int32_t ar = re[k], ai = im[k], br = re[nk], bi = im[nk];
+		//even and odd sample spectra, both doubled. the half size fft only scaled by 2/n, so
+		//quarter the sums to end up with the same 1/n scaling as a full size fft
+		int32_t er = ar + br, ei = ai - bi;
+		int32_t or = ai + bi, oi = br - ar;
+		//rotate the odd part by e^(-2*pi*i*k/n)
+		int j = k << (N_WAVE_LOG2 - m);
+		int32_t c = fixCos(j), s = fixSin(j);
+		int32_t tr = ((c * or) >> 15) + ((s * oi) >> 15);
+		int32_t ti = ((c * oi) >> 15) - ((s * or) >> 15);
 
-		//we can't keep all those extra bits, but 4 of 8 seems like a good value
-		//as this only overloads a little and only for REALLY LOUD inputs
-		t >>= 4;
-		if (t > 0xffff)
-			t = 0xffff;
-		out[i] = t;
+		out[k] = binMagnitude((er + tr) >> 2, (ei + ti) >> 2);
+		if (nk != k)
+			out[nk] = binMagnitude((er - tr) >> 2, (ei - ti) >> 2);
 	}
+	return out;
 }
 
-void processSensorData(int16_t * audioBuffer, int16_t * audio400HzBuffer, volatile uint16_t adcBuffer[7], volatile int16_t accelerometer[3]) {
-	uint16_t magnitude[HIGH_N]; //temp and output from the fft
+//what goes in the main frame for each PROFILE_*, FIELD_BANDS turns into FIELD_CHROMA for PAYLOAD_CHROMA
+static const uint8_t profileFields[PROFILES] = {
+		FIELD_BANDS | FIELD_ENERGY | FIELD_ACCEL | FIELD_LIGHT | FIELD_ANALOG, //PROFILE_FULL
+		FIELD_BANDS | FIELD_ENERGY, //PROFILE_AUDIO
+		FIELD_BANDS | FIELD_ENERGY | FIELD_ACCEL, //PROFILE_AUDIO_ACCEL
+		FIELD_ACCEL | FIELD_LIGHT | FIELD_ANALOG, //PROFILE_SENSORS
+		FIELD_BANDS | FIELD_ENERGY, //PROFILE_MULTIRATE, the rest go in their own frames from outputService()
+};
+
+//frames without audio only go out every so often, about PROFILE_SLOW_HZ
+#define PROFILE_SLOW_FRAMES ((AUDIO_SAMPLE_RATE + HIGH_N * PROFILE_SLOW_HZ / 2) / (HIGH_N * PROFILE_SLOW_HZ))
+
+//light, then a0-a4. only follow an input once it moves past the deadband so it doesn't flicker
+static char * writeAnalog(char * out, uint8_t fields, volatile uint16_t analog[ANALOG_INPUTS]) {
+	static uint16_t analogOut[ANALOG_INPUTS];
+	for (int i = 0; i < ANALOG_INPUTS; i++) {
+		uint16_t v = analog[i];
+		if (abs(v - analogOut[i]) > settings.analogDeadband)
+			analogOut[i] = v;
+		if (fields & (i == 0 ? FIELD_LIGHT : FIELD_ANALOG))
+			WRITEOUT(analogOut[i]);
+	}
+	return out;
+}
+
+//runs both ffts and writes out whichever audio fields are wanted
+static char * writeAudio(char * out, uint8_t fields, int16_t * audioBuffer, int16_t * audio400HzBuffer) {
+	uint16_t * magnitude; //output from the fft, overwrites the input buffer
 	uint16_t lowEnergy;
 	uint16_t energyAverage;
 	int maxFrequencyIndex = 0;
 	uint16_t maxFrequencyMagnitude = 0;
 	uint16_t maxFrequencyHz;
-	char * out = outBuffer;
+	uint32_t chroma[12] = {0};
 
-	//start making output buffer
-	WRITEOUT("SB1.0");
+	//take the dc out of the new block of audio, and use the same level for the low frequency buffer
+	//which is made of slightly older samples from the same stream
+	dcBlock(audioBuffer, HIGH_NLOG2);
+	int16_t dc = (dcLevel + 0x8000) >> 16;
+	for (int i = 0; i < LOW_N; i++) {
+		audio400HzBuffer[i] -= dc;
+	}
 
 	//do the low frequency stuff
-	fftRealWindowedMagnitude(audio400HzBuffer, &magnitude[0], LOW_NLOG2, &lowEnergy);
-	//write out low frequency stuff
-	for (int i = 0, k = lowFrequencyMap[0]; i < 6; i++) {
-		int top = lowFrequencyMap[i] + 1;
-		uint16_t max = 0;
-		for (; k < top; k++) {
-			max = magnitude[k] > max ? magnitude[k] : max;
+	magnitude = fftRealWindowedMagnitude(audio400HzBuffer, LOW_NLOG2, lowWindow, &lowEnergy);
+	if (fields & FIELD_CHROMA) {
+		chromaAccumulate(chroma, &magnitude[CHROMA_LOW_FIRST_BIN], chromaLowMap, CHROMA_LOW_BINS);
+	} else if (fields & FIELD_BANDS) {
+		//write out low frequency stuff
+		for (int i = 0, k = settings.lowBands[0]; i < 6; i++) {
+			int top = settings.lowBands[i] + 1;
+			uint16_t max = 0;
+			for (; k < top; k++) {
+				max = magnitude[k] > max ? magnitude[k] : max;
+			}
+			WRITEOUT(max);
 		}
-		WRITEOUT(max);
 	}
 
 	//do high frequency stuff
-	fftRealWindowedMagnitude(audioBuffer, &magnitude[0], HIGH_NLOG2, &energyAverage);
+	magnitude = fftRealWindowedMagnitude(audioBuffer, HIGH_NLOG2, highWindow, &energyAverage);
 
 	//run through and get maxFrequency info
 	for (int i = 1; i < HIGH_N/2; i++) {
@@ -103,49 +231,225 @@ void processSensorData(int16_t * audioBuffer, int16_t * audio400HzBuffer, volati
 		}
 	}
 
-	//write out high frequency stuff
-	for (int i = 0, k = highFrequencyMap[0]; i < 26; i++) {
-		int top = highFrequencyMap[i] + 1;
-		uint16_t max = 0;
-		for (; k < top; k++) {
-			max = magnitude[k] > max ? magnitude[k] : max;
+	if (fields & FIELD_CHROMA) {
+		chromaAccumulate(chroma, &magnitude[CHROMA_HIGH_FIRST_BIN], chromaHighMap, CHROMA_HIGH_BINS);
+		//write out the 12 pitch classes starting at C, undoing the 16x weighting
+		for (int i = 0; i < 12; i++) {
+			uint32_t t = chroma[i] >> 4;
+			uint16_t v = t > 0xffff ? 0xffff : t;
+			WRITEOUT(v);
+		}
+	} else if (fields & FIELD_BANDS) {
+		//write out high frequency stuff
+		for (int i = 0, k = settings.highBands[0]; i < 26; i++) {
+			int top = settings.highBands[i] + 1;
+			uint16_t max = 0;
+			for (; k < top; k++) {
+				max = magnitude[k] > max ? magnitude[k] : max;
+			}
+			WRITEOUT(max);
 		}
-		WRITEOUT(max);
 	}
 
-	WRITEOUT(energyAverage);
-	WRITEOUT(maxFrequencyMagnitude);
-	maxFrequencyHz = (20000 * (int32_t)maxFrequencyIndex) / 512; //or 39.0625 per bin
-	WRITEOUT(maxFrequencyHz);
+	if (fields & FIELD_ENERGY) {
+		WRITEOUT(energyAverage);
+		WRITEOUT(maxFrequencyMagnitude);
+		maxFrequencyHz = (AUDIO_SAMPLE_RATE * (int32_t)maxFrequencyIndex) / HIGH_N; //or 39.0625 per bin at 20khz
+		WRITEOUT(maxFrequencyHz);
+	}
+	return out;
+}
 
-	for (int i = 0; i < 3; i++) {
-		int16_t v = accelerometer[i];
-		WRITEOUT(v);
+void processSensorData(int16_t * audioBuffer, int16_t * audio400HzBuffer, volatile uint16_t analog[ANALOG_INPUTS]) {
+	uint8_t fields = profileFields[settings.profile];
+	if (settings.payload == PAYLOAD_CHROMA && (fields & FIELD_BANDS))
+		fields ^= FIELD_BANDS | FIELD_CHROMA;
+
+	//light and analog inputs don't change quickly, without audio there's no need to keep up with every block
+	static int slowCount;
+	if (!(fields & FIELD_AUDIO) && ++slowCount < PROFILE_SLOW_FRAMES)
+		return;
+	//outBuffer can't be touched until the last frame is all out, drop this block rather than garble that one
+	//happens when the frames don't fit the baud rate, or while the host is slow to switch to a faster one
+	if (outPending || motionPending || replyPending || (outSending && !usartIdle())) {
+		outputDropped++;
+		return;
 	}
+	slowCount = 0;
 
-	//light
-	uint16_t v = adcBuffer[1]<<4;
-	WRITEOUT(v);
+	//start making output buffer
+	char * out = outBuffer;
+	char * frame = out = frameBegin(out);
+	if (settings.profile != PROFILE_FULL) {
+		//anything but the full frame says what's in it
+		WRITEOUT("SP1.0");
+		WRITEOUT(fields);
+	} else if (settings.payload == PAYLOAD_CHROMA) {
+		WRITEOUT("SC1.0");
+	} else {
+		WRITEOUT("SB1.0");
+	}
 
-	//a0
-	v = adcBuffer[2]<<4;
-	WRITEOUT(v);
-	//a1
-	v = adcBuffer[6]<<4;
-	WRITEOUT(v);
-	//a2
-	v = adcBuffer[5]<<4;
-	WRITEOUT(v);
-	//a3
-	v = adcBuffer[4]<<4;
-	WRITEOUT(v);
-	//a4
-	v = adcBuffer[3]<<4;
-	WRITEOUT(v);
+	if (fields & FIELD_AUDIO)
+		out = writeAudio(out, fields, audioBuffer, audio400HzBuffer);
+
+	//the I2C interrupt can update the stats at any time, take a consistent copy
+	//and start collecting for the next frame, unless the motion frame that follows is going to
+	int16_t mean[3];
+	__disable_irq();
+	memcpy(mean, accelStats.mean, sizeof(mean));
+	if (!settings.motion) {
+		accelStats.events = 0;
+		accelStats.samples = 0;
+	}
+	__enable_irq();
+	if (fields & FIELD_ACCEL)
+		WRITEOUT(mean);
 
+	out = writeAnalog(out, fields, analog);
 
-	WRITEOUT("END");
+	//delta coding only knows the full frame layouts
+	if (settings.compress && settings.profile == PROFILE_FULL)
+		out = compressFrame(frame, out);
+	out = frameEnd(frame, out);
 
 	outBufferLen = out - outBuffer;
-	writeToUsart((uint8_t *) outBuffer, outBufferLen);
+	outPending = true;
+	motionPending = settings.motion;
+	//the reply to any command that came in follows
+	replyPending = true;
+	outputService(analog);
+}
+
+//the "SM1.0" frame into outBuffer, with the stats since the last one
+//it goes out a few ms after the main frame, a poll may have come in between
+static void writeMotion() {
+	AccelStats motion;
+	__disable_irq();
+	motion = accelStats;
+	accelStats.events = 0;
+	accelStats.samples = 0;
+	__enable_irq();
+
+	char * out = outBuffer;
+	char * frame = out = frameBegin(out);
+	WRITEOUT("SM1.0");
+	WRITEOUT(motion.mean);
+	WRITEOUT(motion.peak);
+	WRITEOUT(motion.rms);
+	WRITEOUT(motion.jerk);
+	WRITEOUT(motion.samples);
+	WRITEOUT(motion.sampleMs);
+	WRITEOUT(motion.shake);
+	WRITEOUT(motion.pitch);
+	WRITEOUT(motion.roll);
+	WRITEOUT(motion.orientation);
+	WRITEOUT(motion.events);
+	WRITEOUT(motion.eventMs);
+	uint16_t now = ms;
+	WRITEOUT(now);
+	out = frameEnd(frame, out);
+	outBufferLen = out - outBuffer;
+}
+_Static_assert(6 + 38 + 2 + 4 <= OUT_BUFFER_SIZE, "the motion frame has to fit the output buffer");
+
+//with PROFILE_MULTIRATE the slower changing fields go out in their own small "SP1.0" frames
+//squeezed in between the audio frames, whenever they're due and the uart is free
+//the accelerometer goes out once per poll with the average so far, light and analog inputs at PROFILE_SLOW_HZ
+//the frame with the audio always goes first, it only ever has to wait for a small frame to finish
+static char subBuffer[24]; //6 + 1 + 12 for light and analog, plus the end of the frame
+static uint32_t subSlowMs;
+static uint16_t subAccelMs;
+
+//nothing being sent or waiting to be
+bool outputIdle() {
+	return !outPending && !motionPending && !replyPending && usartIdle();
+}
+
+//call from the main loop, starts the next frame once the uart is free
+void outputService(volatile uint16_t analog[ANALOG_INPUTS]) {
+	if (!usartIdle())
+		return;
+	if (motionPending && !outPending) {
+		motionPending = false;
+		writeMotion();
+		outPending = true;
+	}
+	if (replyPending && !outPending) {
+		replyPending = false;
+		char * frame = frameBegin(outBuffer);
+		int len = commandTakeReply(frame);
+		if (len) {
+			outBufferLen = frameEnd(frame, frame + len) - outBuffer;
+			outPending = true;
+		}
+	}
+	if (outPending) {
+		outPending = false;
+		outSending = true;
+		writeToUsart((uint8_t *) outBuffer, outBufferLen);
+		return;
+	}
+	if (settings.profile != PROFILE_MULTIRATE)
+		return;
+
+	uint8_t fields;
+	int16_t mean[3];
+	if (ms - subSlowMs >= 1000 / PROFILE_SLOW_HZ) {
+		subSlowMs = ms;
+		fields = FIELD_LIGHT | FIELD_ANALOG;
+	} else if (accelStats.sampleMs != subAccelMs) {
+		__disable_irq();
+		subAccelMs = accelStats.sampleMs;
+		memcpy(mean, accelStats.mean, sizeof(mean));
+		__enable_irq();
+		fields = FIELD_ACCEL;
+	} else {
+		return;
+	}
+
+	char * out = subBuffer;
+	char * frame = out = frameBegin(out);
+	WRITEOUT("SP1.0");
+	WRITEOUT(fields);
+	if (fields & FIELD_ACCEL)
+		WRITEOUT(mean);
+	out = writeAnalog(out, fields, analog);
+	out = frameEnd(frame, out);
+	outSending = false;
+	writeToUsart((uint8_t *) subBuffer, out - subBuffer);
+}
+
+//bytes the fields take in a frame
+static int fieldsBytes(uint8_t fields) {
+	static const uint8_t bytes[] = {64, 24, 6, 6, 2, 10}; //FIELD_BANDS to FIELD_ANALOG
+	int total = 0;
+	for (int i = 0; i < 6; i++)
+		if (fields & (1 << i))
+			total += bytes[i];
+	return total;
+}
+
+/*
+ * Bits per second on the uart, start and stop bits included, that the frames need with these settings
+ * each frame is counted at its biggest. replies aren't, there's only ever one per command
+ */
+uint32_t outputBitsPerSecond(const Settings * s) {
+	uint8_t fields = profileFields[s->profile];
+	if (s->payload == PAYLOAD_CHROMA && (fields & FIELD_BANDS))
+		fields ^= FIELD_BANDS | FIELD_CHROMA;
+	int end = s->framing == FRAMING_COBS ? 2 : 4; //the code byte in front and the 0, or "END"
+	//the main frame, delta coding adds 3 bytes at worst, and the motion frame that goes with it
+	int bytes = 6 + (s->profile != PROFILE_FULL) + fieldsBytes(fields) + end;
+	if (s->compress && s->profile == PROFILE_FULL)
+		bytes += 3;
+	if (s->motion)
+		bytes += 6 + 40 + end;
+	uint32_t blocks = fields & FIELD_AUDIO ? HIGH_N : HIGH_N * PROFILE_SLOW_FRAMES;
+	uint32_t bits = (bytes * 10 * AUDIO_SAMPLE_RATE + blocks - 1) / blocks;
+	if (s->profile == PROFILE_MULTIRATE) {
+		bits += (7 + fieldsBytes(FIELD_ACCEL) + end) * 10 * 1000 / ACCEL_POLL_MS;
+		bits += (7 + fieldsBytes(FIELD_LIGHT | FIELD_ANALOG) + end) * 10 * PROFILE_SLOW_HZ;
+	}
+	return bits;
 }
@@ -0,0 +1,106 @@
+#include "main.h"
+
+//settings that can be changed at runtime over the UART, see command.c
+//they start out from the defaults below, or whatever was last saved to the reserved flash page
+
+//the first 6 bands are dedicated to low frequency audio from 12.5-162.5 Hz, listed as the top bin of each
+//the next 26 bands are dedicated to higher frequency audio from 195Hz to just under the nyquist limit
+//listed as the top frequency of each band, the last always runs up to nyquist
+//at lower sample rates the bands past nyquist all end at the last bin, so they're empty and come out as 0
+#define HZ_TO_BIN(hz) (((hz) * HIGH_N + AUDIO_SAMPLE_RATE / 2) / AUDIO_SAMPLE_RATE)
+#define HIGH_BUCKET(hz) (HZ_TO_BIN(hz) < HIGH_N / 2 - 1 ? HZ_TO_BIN(hz) : HIGH_N / 2 - 1)
+//the edges below only ever go up, so this is all it takes for the defaults to pass settingsValid()
+_Static_assert(HIGH_BUCKET(195) >= 1, "the default high bands have to start inside the fft");
+
+const Settings defaultSettings = {
+		.payload = DEFAULT_PAYLOAD,
+		.motion = DEFAULT_MOTION,
+		.analogFilterShift = ANALOG_FILTER_SHIFT,
+		.compress = DEFAULT_COMPRESS,
+		.analogDeadband = ANALOG_DEADBAND,
+		.shakeMg = ACCEL_SHAKE_MG,
+		.lowBands = {
+				3, 4, 6, 8, 10, 13
+		},
+		.highBands = {
+				HIGH_BUCKET(195), HIGH_BUCKET(234), HIGH_BUCKET(312), HIGH_BUCKET(391), HIGH_BUCKET(469), HIGH_BUCKET(586),
+				HIGH_BUCKET(703), HIGH_BUCKET(859), HIGH_BUCKET(977), HIGH_BUCKET(1172), HIGH_BUCKET(1367), HIGH_BUCKET(1562),
+				HIGH_BUCKET(1797), HIGH_BUCKET(2070), HIGH_BUCKET(2383), HIGH_BUCKET(2734), HIGH_BUCKET(3125), HIGH_BUCKET(3594),
+				HIGH_BUCKET(4102), HIGH_BUCKET(4648), HIGH_BUCKET(5312), HIGH_BUCKET(6016), HIGH_BUCKET(6836), HIGH_BUCKET(7773),
+				HIGH_BUCKET(8789), HIGH_N / 2 - 1,
+		},
+		.framing = DEFAULT_FRAMING,
+		.profile = DEFAULT_PROFILE,
+};
+
+Settings settings;
+
+//what goes in flash, the magic number changes whenever Settings does so old pages get ignored
+#define SETTINGS_MAGIC 0x53420004
+typedef struct {
+	uint32_t magic;
+	Settings settings;
+	uint16_t checksum;
+} StoredSettings;
+_Static_assert(sizeof(StoredSettings) % 2 == 0, "flash is written in half words");
+
+static uint16_t settingsChecksum(const Settings * s) {
+	const uint8_t * p = (const uint8_t *) s;
+	uint16_t sum = 0;
+	for (unsigned i = 0; i < sizeof(Settings); i++)
+		sum = (sum << 1 | sum >> 15) + p[i];
+	return sum;
+}
+
+//band edges can't go down and have to stay inside the fft. a band ending where the last one did is empty
+static bool bandsValid(const uint8_t * bands, int count, int first, int last) {
+	for (int i = 0; i < count; i++) {
+		if (bands[i] < first || bands[i] > last)
+			return false;
+		first = bands[i];
+	}
+	return true;
+}
+
+bool settingsValid(const Settings * s) {
+	return s->payload <= PAYLOAD_CHROMA &&
+			s->motion <= 1 &&
+			s->compress <= 1 &&
+			s->framing <= FRAMING_COBS &&
+			s->profile < PROFILES &&
+			s->analogFilterShift <= 8 &&
+			bandsValid(s->lowBands, 6, 1, LOW_N / 2 - 1) &&
+			bandsValid(s->highBands, 26, 1, HIGH_N / 2 - 1);
+}
+
+//load from flash if there's something good there
+void initSettings() {
+	const StoredSettings * stored = (const StoredSettings *) SETTINGS_FLASH_ADDR;
+	if (stored->magic == SETTINGS_MAGIC && stored->checksum == settingsChecksum(&stored->settings) &&
+			settingsValid(&stored->settings))
+		settings = stored->settings;
+	else
+		settings = defaultSettings;
+}
+
+//erase the reserved page and write the current settings to it
+//the cpu stalls while flash is erased, so a frame or two of audio gets lost. only happens when asked to
+bool saveSettings() {
+	StoredSettings stored = {
+			.magic = SETTINGS_MAGIC,
+			.settings = settings,
+			.checksum = settingsChecksum(&settings)
+	};
+	const uint16_t * p = (const uint16_t *) &stored;
+	bool ok = true;
+
+	FLASH_Unlock();
+	if (FLASH_ErasePage(SETTINGS_FLASH_ADDR) != FLASH_COMPLETE)
+		ok = false;
+	for (unsigned i = 0; ok && i < sizeof(stored) / 2; i++) {
+		if (FLASH_ProgramHalfWord(SETTINGS_FLASH_ADDR + i * 2, p[i]) != FLASH_COMPLETE)
+			ok = false;
+	}
+	FLASH_Lock();
+	return ok;
+}
@@ -0,0 +1,22 @@
+#include "main.h"
+#include "repeat.h"
+
+//window tables for each fft size, generated by the compiler for whichever shape is configured in main.h
+//windows are periodic and symmetric, so only n/2+1 entries are stored and fftRealWindowedMagnitude mirrors the rest
+//values are Q15 with 1.0 at the peak
+
+#define WINDOW_Q15(shape, i, n) (int16_t) __builtin_round(shape(6.283185307179586 * (i) / (n)) * 32767),
+
+_Static_assert(LOW_N == 32 && HIGH_N == 512, "update the REPEAT counts below to match the fft sizes");
+
+#define LOW_WINDOW_ENTRY(i) WINDOW_Q15(LOW_WINDOW, i, LOW_N)
+const int16_t lowWindow[LOW_N / 2 + 1] = {
+		REPEAT(16, LOW_WINDOW_ENTRY, 0)
+		LOW_WINDOW_ENTRY(LOW_N / 2)
+};
+
+#define HIGH_WINDOW_ENTRY(i) WINDOW_Q15(HIGH_WINDOW, i, HIGH_N)
+const int16_t highWindow[HIGH_N / 2 + 1] = {
+		REPEAT(256, HIGH_WINDOW_ENTRY, 0)
+		HIGH_WINDOW_ENTRY(HIGH_N / 2)
+};
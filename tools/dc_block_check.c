@@ -0,0 +1,148 @@
+//Runs the real dcBlock() from src/output.c on made up signals, to check the numbers next to
+//DC_BLOCK_CORNER_HZ in main.h whenever it or AUDIO_SAMPLE_RATE changes. Links the same files as tools/sim:
+//  gcc -O2 -std=gnu11 -Itools/sim -Iinc -o dc_block_check tools/dc_block_check.c tools/sim/sim_board.c
+//      src/acquire.c src/output.c src/chroma.c src/fix_fft.c src/window.c src/libfixmath_sqrt.c src/settings.c
+//      src/compress.c src/motion.c src/i2c.c src/accelerometer.c src/command.c -lm
+//  ./dc_block_check [hz...]
+//Build with -DDC_BLOCK_CORNER_HZ=... and -DAUDIO_SAMPLE_RATE=... to try others.
+//Prints where the response is 3dB down, how far down it is at each hz (37 if none are given), and how long
+//a step takes to settle to within 1%. Audio goes through a block at a time in FFT_SLOT order like the firmware,
+//so the ordering and the rounding are checked along with the filter.
+//It returns 1 if a sine sweep from well under the corner up to a quarter of the sample rate is more than
+//0.05dB off the filter dcBlock() is meant to be, or if a full scale step wraps around.
+
+#include "main.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MID 16384 //ADC mid scale, shifted up 3 bits by the ISR
+#define AMPLITUDE 8000
+#define TAU (AUDIO_SAMPLE_RATE / (6.283185307179586 * DC_BLOCK_CORNER_HZ)) //time constant in samples
+//same as DC_BLOCK_K in src/output.c
+#define K ((int32_t) (6.283185307179586 * DC_BLOCK_CORNER_HZ * 65536 / AUDIO_SAMPLE_RATE + 0.5))
+#define TOLERANCE_DB 0.05
+
+static int blocks(double samples) {
+	return (int) ceil(samples / HIGH_N);
+}
+
+//runs count blocks of audio through dcBlock(), in place and in time order
+static void filter(int16_t * audio, int count) {
+	static int16_t block[HIGH_N];
+	for (int b = 0; b < count; b++, audio += HIGH_N) {
+		for (int i = 0; i < HIGH_N; i++)
+			block[FFT_SLOT(i, HIGH_NLOG2)] = audio[i];
+		dcBlock(block, HIGH_NLOG2);
+		for (int i = 0; i < HIGH_N; i++)
+			audio[i] = block[FFT_SLOT(i, HIGH_NLOG2)];
+	}
+}
+
+//holds the input at level until the filter has long since caught up, dcBlock() carries on from there
+static void settle(int16_t level) {
+	int count = blocks(40 * TAU);
+	int16_t * audio = malloc(count * HIGH_N * sizeof(int16_t));
+	for (int i = 0; i < count * HIGH_N; i++)
+		audio[i] = level;
+	filter(audio, count);
+	free(audio);
+}
+
+//response to a sine at hz, after letting the filter settle on it
+static double gainDb(double hz) {
+	double period = AUDIO_SAMPLE_RATE / hz;
+	int skip = (int) fmax(20 * TAU, 4 * period);
+	int cycles = (int) fmax(4, round(AUDIO_SAMPLE_RATE * 0.25 / period));
+	int n = (int) round(cycles * period);
+	int count = blocks(skip + n);
+	int16_t * audio = malloc(count * HIGH_N * sizeof(int16_t));
+	for (int i = 0; i < count * HIGH_N; i++)
+		audio[i] = MID + lround(AMPLITUDE * sin(2 * M_PI * hz * i / AUDIO_SAMPLE_RATE));
+	settle(MID);
+	filter(audio, count);
+	//correlate over whole cycles, so it's only the part at hz that counts
+	double c = 0, s = 0;
+	for (int i = skip; i < skip + n; i++) {
+		c += audio[i] * cos(2 * M_PI * hz * i / AUDIO_SAMPLE_RATE);
+		s += audio[i] * sin(2 * M_PI * hz * i / AUDIO_SAMPLE_RATE);
+	}
+	free(audio);
+	return 20 * log10(2 * hypot(c, s) / n / AMPLITUDE);
+}
+
+//the filter without any rounding, y = x - dc, dc += k * y: H(z) = (1 - 1/z) / (1 - (1 - k)/z)
+static double expectDb(double hz) {
+	double w = 2 * M_PI * hz / AUDIO_SAMPLE_RATE, a = 1 - K / 65536.0;
+	return 20 * log10(2 * sin(w / 2) / sqrt(1 - 2 * a * cos(w) + a * a));
+}
+
+//prints the gain at hz next to what it should be, returns 1 if it's too far off
+static int checkGain(double hz) {
+	double db = gainDb(hz), expect = expectDb(hz);
+	bool bad = fabs(db - expect) > TOLERANCE_DB;
+	printf("  %.2fdB at %g Hz, %.2fdB expected%s\n", db, hz, expect, bad ? ", too far off" : "");
+	return bad;
+}
+
+static double cornerHz() {
+	double lo = DC_BLOCK_CORNER_HZ / 4.0, hi = DC_BLOCK_CORNER_HZ * 4.0;
+	for (int i = 0; i < 30; i++) {
+		double mid = sqrt(lo * hi);
+		if (gainDb(mid) < -3.0103)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return sqrt(lo * hi);
+}
+
+//a step from a settled level for 10 seconds. returns how long until the output stays within 1% of 0,
+//and the first, lowest and last outputs
+static double step(int16_t from, int16_t to, int * first, int * lowest, int * last) {
+	int count = blocks(AUDIO_SAMPLE_RATE * 10.0);
+	int16_t * audio = malloc(count * HIGH_N * sizeof(int16_t));
+	for (int i = 0; i < count * HIGH_N; i++)
+		audio[i] = to;
+	settle(from);
+	filter(audio, count);
+	int settled = 0;
+	*lowest = audio[0];
+	for (int i = 0; i < count * HIGH_N; i++) {
+		if (abs(audio[i]) > abs(to - from) / 100)
+			settled = i + 1;
+		if (audio[i] < *lowest)
+			*lowest = audio[i];
+	}
+	*first = audio[0];
+	*last = audio[count * HIGH_N - 1];
+	free(audio);
+	return settled * 1000.0 / AUDIO_SAMPLE_RATE;
+}
+
+int main(int argc, char ** argv) {
+	int failures = 0;
+	printf("DC_BLOCK_CORNER_HZ %d at %d Hz, k %d\n", DC_BLOCK_CORNER_HZ, AUDIO_SAMPLE_RATE, (int) K);
+	printf("  -3dB at %.2f Hz\n", cornerHz());
+	if (argc < 2)
+		failures += checkGain(37);
+	for (int i = 1; i < argc; i++)
+		failures += checkGain(atof(argv[i]));
+	printf("sweep:\n");
+	for (double hz = DC_BLOCK_CORNER_HZ / 4.0; hz <= AUDIO_SAMPLE_RATE / 4; hz *= 2)
+		failures += checkGain(hz);
+
+	int first, lowest, last;
+	double ms = step(MID, MID + AMPLITUDE, &first, &lowest, &last);
+	printf("  a step settles to within 1%% in %.0f ms, and to %d after 10 s\n", ms, last);
+	//the biggest the ADC can do, from all the way down to all the way up
+	int top = 4095 << 3;
+	ms = step(0, top, &first, &lowest, &last);
+	printf("  a full scale step starts at %d, settles in %.0f ms, lowest %d\n", first, ms, lowest);
+	if (first != top || lowest < -1) {
+		printf("  the full scale step wrapped around\n");
+		failures++;
+	}
+	return failures ? 1 : 0;
+}
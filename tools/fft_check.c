@@ -0,0 +1,432 @@
+//Checks fix_fft() and fixSin()/fixCos() against the versions they replaced, and times both.
+//The old fix_fft and its 3/4 wave Sinewave[] table are kept below as they were, only renamed.
+//  gcc -O2 -std=gnu11 -Itools/sim -Iinc -o fft_check tools/fft_check.c src/fix_fft.c
+//  ./fft_check [rounds]
+//Every size fix_fft takes, forward and inverse, on random input from quiet to full scale: the outputs
+//and the returned scale have to be identical. Then every fixSin()/fixCos() index against the old table.
+//Timings are on the host, they show whether anything got slower, not what the chip does. There's a copy
+//in between too, with the tightened butterfly still reading the old table, so each change is timed on its own.
+//Keep this in sync with src/fix_fft.c and fixSin() in main.h
+
+#include "main.h"
+
+#include <stdio.h>
+#include <time.h>
+
+/*
+ * fix_fft.c before the butterfly was tightened and the sine table cut to a quarter wave
+ */
+
+static const short oldSinewave[768] = {
+      0,    201,    402,    603,    804,   1005,   1206,   1406,
+   1607,   1808,   2009,   2209,   2410,   2610,   2811,   3011,
+   3211,   3411,   3611,   3811,   4011,   4210,   4409,   4608,
+   4807,   5006,   5205,   5403,   5601,   5799,   5997,   6195,
+   6392,   6589,   6786,   6982,   7179,   7375,   7571,   7766,
+   7961,   8156,   8351,   8545,   8739,   8932,   9126,   9319,
+   9511,   9703,   9895,  10087,  10278,  10469,  10659,  10849,
+  11038,  11227,  11416,  11604,  11792,  11980,  12166,  12353,
+  12539,  12724,  12909,  13094,  13278,  13462,  13645,  13827,
+  14009,  14191,  14372,  14552,  14732,  14911,  15090,  15268,
+  15446,  15623,  15799,  15975,  16150,  16325,  16499,  16672,
+  16845,  17017,  17189,  17360,  17530,  17699,  17868,  18036,
+  18204,  18371,  18537,  18702,  18867,  19031,  19194,  19357,
+  19519,  19680,  19840,  20000,  20159,  20317,  20474,  20631,
+  20787,  20942,  21096,  21249,  21402,  21554,  21705,  21855,
+  22004,  22153,  22301,  22448,  22594,  22739,  22883,  23027,
+  23169,  23311,  23452,  23592,  23731,  23869,  24006,  24143,
+  24278,  24413,  24546,  24679,  24811,  24942,  25072,  25201,
+  25329,  25456,  25582,  25707,  25831,  25954,  26077,  26198,
+  26318,  26437,  26556,  26673,  26789,  26905,  27019,  27132,
+  27244,  27355,  27466,  27575,  27683,  27790,  27896,  28001,
+  28105,  28208,  28309,  28410,  28510,  28608,  28706,  28802,
+  28897,  28992,  29085,  29177,  29268,  29358,  29446,  29534,
+  29621,  29706,  29790,  29873,  29955,  30036,  30116,  30195,
+  30272,  30349,  30424,  30498,  30571,  30643,  30713,  30783,
+  30851,  30918,  30984,  31049,  31113,  31175,  31236,  31297,
+  31356,  31413,  31470,  31525,  31580,  31633,  31684,  31735,
+  31785,  31833,  31880,  31926,  31970,  32014,  32056,  32097,
+  32137,  32176,  32213,  32249,  32284,  32318,  32350,  32382,
+  32412,  32441,  32468,  32495,  32520,  32544,  32567,  32588,
+  32609,  32628,  32646,  32662,  32678,  32692,  32705,  32717,
+  32727,  32736,  32744,  32751,  32757,  32761,  32764,  32766,
+  32767,  32766,  32764,  32761,  32757,  32751,  32744,  32736,
+  32727,  32717,  32705,  32692,  32678,  32662,  32646,  32628,
+  32609,  32588,  32567,  32544,  32520,  32495,  32468,  32441,
+  32412,  32382,  32350,  32318,  32284,  32249,  32213,  32176,
+  32137,  32097,  32056,  32014,  31970,  31926,  31880,  31833,
+  31785,  31735,  31684,  31633,  31580,  31525,  31470,  31413,
+  31356,  31297,  31236,  31175,  31113,  31049,  30984,  30918,
+  30851,  30783,  30713,  30643,  30571,  30498,  30424,  30349,
+  30272,  30195,  30116,  30036,  29955,  29873,  29790,  29706,
+  29621,  29534,  29446,  29358,  29268,  29177,  29085,  28992,
+  28897,  28802,  28706,  28608,  28510,  28410,  28309,  28208,
+  28105,  28001,  27896,  27790,  27683,  27575,  27466,  27355,
+  27244,  27132,  27019,  26905,  26789,  26673,  26556,  26437,
+  26318,  26198,  26077,  25954,  25831,  25707,  25582,  25456,
+  25329,  25201,  25072,  24942,  24811,  24679,  24546,  24413,
+  24278,  24143,  24006,  23869,  23731,  23592,  23452,  23311,
+  23169,  23027,  22883,  22739,  22594,  22448,  22301,  22153,
+  22004,  21855,  21705,  21554,  21402,  21249,  21096,  20942,
+  20787,  20631,  20474,  20317,  20159,  20000,  19840,  19680,
+  19519,  19357,  19194,  19031,  18867,  18702,  18537,  18371,
+  18204,  18036,  17868,  17699,  17530,  17360,  17189,  17017,
+  16845,  16672,  16499,  16325,  16150,  15975,  15799,  15623,
+  15446,  15268,  15090,  14911,  14732,  14552,  14372,  14191,
+  14009,  13827,  13645,  13462,  13278,  13094,  12909,  12724,
+  12539,  12353,  12166,  11980,  11792,  11604,  11416,  11227,
+  11038,  10849,  10659,  10469,  10278,  10087,   9895,   9703,
+   9511,   9319,   9126,   8932,   8739,   8545,   8351,   8156,
+   7961,   7766,   7571,   7375,   7179,   6982,   6786,   6589,
+   6392,   6195,   5997,   5799,   5601,   5403,   5205,   5006,
+   4807,   4608,   4409,   4210,   4011,   3811,   3611,   3411,
+   3211,   3011,   2811,   2610,   2410,   2209,   2009,   1808,
+   1607,   1406,   1206,   1005,    804,    603,    402,    201,
+      0,   -201,   -402,   -603,   -804,  -1005,  -1206,  -1406,
+  -1607,  -1808,  -2009,  -2209,  -2410,  -2610,  -2811,  -3011,
+  -3211,  -3411,  -3611,  -3811,  -4011,  -4210,  -4409,  -4608,
+  -4807,  -5006,  -5205,  -5403,  -5601,  -5799,  -5997,  -6195,
+  -6392,  -6589,  -6786,  -6982,  -7179,  -7375,  -7571,  -7766,
+  -7961,  -8156,  -8351,  -8545,  -8739,  -8932,  -9126,  -9319,
+  -9511,  -9703,  -9895, -10087, -10278, -10469, -10659, -10849,
+ -11038, -11227, -11416, -11604, -11792, -11980, -12166, -12353,
+ -12539, -12724, -12909, -13094, -13278, -13462, -13645, -13827,
+ -14009, -14191, -14372, -14552, -14732, -14911, -15090, -15268,
+ -15446, -15623, -15799, -15975, -16150, -16325, -16499, -16672,
+ -16845, -17017, -17189, -17360, -17530, -17699, -17868, -18036,
+ -18204, -18371, -18537, -18702, -18867, -19031, -19194, -19357,
+ -19519, -19680, -19840, -20000, -20159, -20317, -20474, -20631,
+ -20787, -20942, -21096, -21249, -21402, -21554, -21705, -21855,
+ -22004, -22153, -22301, -22448, -22594, -22739, -22883, -23027,
+ -23169, -23311, -23452, -23592, -23731, -23869, -24006, -24143,
+ -24278, -24413, -24546, -24679, -24811, -24942, -25072, -25201,
+ -25329, -25456, -25582, -25707, -25831, -25954, -26077, -26198,
+ -26318, -26437, -26556, -26673, -26789, -26905, -27019, -27132,
+ -27244, -27355, -27466, -27575, -27683, -27790, -27896, -28001,
+ -28105, -28208, -28309, -28410, -28510, -28608, -28706, -28802,
+ -28897, -28992, -29085, -29177, -29268, -29358, -29446, -29534,
+ -29621, -29706, -29790, -29873, -29955, -30036, -30116, -30195,
+ -30272, -30349, -30424, -30498, -30571, -30643, -30713, -30783,
+ -30851, -30918, -30984, -31049, -31113, -31175, -31236, -31297,
+ -31356, -31413, -31470, -31525, -31580, -31633, -31684, -31735,
+ -31785, -31833, -31880, -31926, -31970, -32014, -32056, -32097,
+ -32137, -32176, -32213, -32249, -32284, -32318, -32350, -32382,
+ -32412, -32441, -32468, -32495, -32520, -32544, -32567, -32588,
+ -32609, -32628, -32646, -32662, -32678, -32692, -32705, -32717,
+ -32727, -32736, -32744, -32751, -32757, -32761, -32764, -32766,
+};
+
+static short oldFixMpy(short a, short b)
+{
+	/* shift right one less bit (i.e. 15-1) */
+	int c = ((int)a * (int)b) >> 14;
+	/* last bit shifted out = rounding-bit */
+	b = c & 0x01;
+	/* last shift + rounding bit */
+	a = (c >> 1) + b;
+	return a;
+}
+
+static int oldFixFft(short fr[], short fi[], short m, short inverse)
+{
+	int mr, nn, i, j, l, k, istep, n, scale, shift;
+	short qr, qi, tr, ti, wr, wi;
+
+	n = 1 << m;
+
+	/* max FFT size = 1024 */
+	if (n > 1024)
+		return -1;
+
+	mr = 0;
+	nn = n - 1;
+	scale = 0;
+
+	/* decimation in time - re-order data */
+	for (m=1; m<=nn; ++m) {
+		l = n;
+		do {
+			l >>= 1;
+		} while (mr+l > nn);
+		mr = (mr & (l-1)) + l;
+
+		if (mr <= m)
+			continue;
+		tr = fr[m];
+		fr[m] = fr[mr];
+		fr[mr] = tr;
+		ti = fi[m];
+		fi[m] = fi[mr];
+		fi[mr] = ti;
+	}
+
+	l = 1;
+	k = 10-1;
+	while (l < n) {
+		if (inverse) {
+			/* variable scaling, depending upon data */
+			shift = 0;
+			for (i=0; i<n; ++i) {
+				j = fr[i];
+				if (j < 0)
+					j = -j;
+				m = fi[i];
+				if (m < 0)
+					m = -m;
+				if (j > 16383 || m > 16383) {
+					shift = 1;
+					break;
+				}
+			}
+			if (shift)
+				++scale;
+		} else {
+			/*
+			  fixed scaling, for proper normalization --
+			  there will be log2(n) passes, so this results
+			  in an overall factor of 1/n, distributed to
+			  maximize arithmetic accuracy.
+			*/
+			shift = 1;
+		}
+		/*
+		  it may not be obvious, but the shift will be
+		  performed on each data point exactly once,
+		  during this pass.
+		*/
+		istep = l << 1;
+		for (m=0; m<l; ++m) {
+			j = m << k;
+			/* 0 <= j < 1024/2 */
+			wr =  oldSinewave[j+256];
+			wi = -oldSinewave[j];
+			if (inverse)
+				wi = -wi;
+			if (shift) {
+				wr >>= 1;
+				wi >>= 1;
+			}
+			for (i=m; i<n; i+=istep) {
+				j = i + l;
+				tr = oldFixMpy(wr,fr[j]) - oldFixMpy(wi,fi[j]);
+				ti = oldFixMpy(wr,fi[j]) + oldFixMpy(wi,fr[j]);
+				qr = fr[i];
+				qi = fi[i];
+				if (shift) {
+					qr >>= 1;
+					qi >>= 1;
+				}
+				fr[j] = qr - tr;
+				fi[j] = qi - ti;
+				fr[i] = qr + tr;
+				fi[i] = qi + ti;
+			}
+		}
+		--k;
+		l = istep;
+	}
+	return scale;
+}
+
+/*
+ * fix_fft.c after the butterfly was tightened, but still on the old table,
+ * so the cost of each change can be timed on its own
+ */
+
+static inline __attribute__((always_inline)) short midFixMpy(short a, short b)
+{
+	return ((int)a * (int)b + (1 << 14)) >> 15;
+}
+
+static int midFixFft(short fr[], short fi[], short m, short inverse)
+{
+	int mr, nn, i, j, l, k, istep, n, scale, shift;
+	short qr, qi, tr, ti, wr, wi;
+
+	n = 1 << m;
+
+	/* max FFT size = 1024 */
+	if (n > 1024)
+		return -1;
+
+	mr = 0;
+	nn = n - 1;
+	scale = 0;
+
+	/* decimation in time - re-order data */
+	for (m=1; m<=nn; ++m) {
+		l = n;
+		do {
+			l >>= 1;
+		} while (mr+l > nn);
+		mr = (mr & (l-1)) + l;
+
+		if (mr <= m)
+			continue;
+		tr = fr[m];
+		fr[m] = fr[mr];
+		fr[mr] = tr;
+		ti = fi[m];
+		fi[m] = fi[mr];
+		fi[mr] = ti;
+	}
+
+	l = 1;
+	k = 10-1;
+	while (l < n) {
+		if (inverse) {
+			/* variable scaling, depending upon data */
+			shift = 0;
+			for (i=0; i<n; ++i) {
+				j = fr[i];
+				if (j < 0)
+					j = -j;
+				m = fi[i];
+				if (m < 0)
+					m = -m;
+				if (j > 16383 || m > 16383) {
+					shift = 1;
+					break;
+				}
+			}
+			if (shift)
+				++scale;
+		} else {
+			shift = 1;
+		}
+		istep = l << 1;
+		for (m=0; m<l; ++m) {
+			j = m << k;
+			/* 0 <= j < 1024/2 */
+			wr =  oldSinewave[j+256];
+			wi = -oldSinewave[j];
+			if (inverse)
+				wi = -wi;
+			wr >>= shift;
+			wi >>= shift;
+			for (i=m; i<n; i+=istep) {
+				short xr, xi;
+				j = i + l;
+				xr = fr[j];
+				xi = fi[j];
+				tr = midFixMpy(wr,xr) - midFixMpy(wi,xi);
+				ti = midFixMpy(wr,xi) + midFixMpy(wi,xr);
+				qr = fr[i] >> shift;
+				qi = fi[i] >> shift;
+				fr[j] = qr - tr;
+				fi[j] = qi - ti;
+				fr[i] = qr + tr;
+				fi[i] = qi + ti;
+			}
+		}
+		--k;
+		l = istep;
+	}
+	return scale;
+}
+
+/*
+ * the checks
+ */
+
+static uint32_t rngState = 1;
+
+static uint32_t rng() {
+	rngState ^= rngState << 13;
+	rngState ^= rngState >> 17;
+	rngState ^= rngState << 5;
+	return rngState;
+}
+
+static double seconds() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+//random samples up to bits bits, a full scale one now and then so the edges get hit too
+static void fill(short * a, int n, int bits) {
+	for (int i = 0; i < n; i++) {
+		int r = rng() % 64;
+		a[i] = r == 0 ? 32767 : r == 1 ? -32768 : (short) ((int32_t) rng() >> (32 - bits));
+	}
+}
+
+static int checkFft(int rounds) {
+	static short fr[1024], fi[1024], or[1024], oi[1024], mr[1024], mi[1024];
+	int failures = 0;
+	for (int m = 1; m <= N_WAVE_LOG2; m++) {
+		int n = 1 << m;
+		for (int inverse = 0; inverse <= 1; inverse++) {
+			for (int round = 0; round < rounds; round++) {
+				fill(fr, n, 1 + round % 16);
+				fill(fi, n, 1 + round % 16);
+				memcpy(or, fr, n * 2);
+				memcpy(oi, fi, n * 2);
+				memcpy(mr, fr, n * 2);
+				memcpy(mi, fi, n * 2);
+				int scale = fix_fft(fr, fi, m, inverse);
+				int oldScale = oldFixFft(or, oi, m, inverse);
+				int midScale = midFixFft(mr, mi, m, inverse);
+				if (scale != oldScale || memcmp(fr, or, n * 2) || memcmp(fi, oi, n * 2) ||
+						midScale != oldScale || memcmp(mr, or, n * 2) || memcmp(mi, oi, n * 2)) {
+					printf("fix_fft differs: %d points, %s, round %d\n", n, inverse ? "inverse" : "forward", round);
+					failures++;
+					break;
+				}
+			}
+		}
+	}
+	printf("fix_fft: %d rounds each of 2 to %d points, forward and inverse, %s\n", rounds, 1 << N_WAVE_LOG2,
+			failures ? "DIFFERENT" : "identical");
+	return failures;
+}
+
+static int checkSin() {
+	int failures = 0;
+	//the old table only covered 3/4 of a period, fix_fft looked up sin in the first half and cos a quarter on
+	for (int j = 0; j < 768; j++) {
+		if (fixSin(j) != oldSinewave[j] || (j < 512 && fixCos(j) != oldSinewave[j + 256])) {
+			printf("fixSin/fixCos differ at %d\n", j);
+			failures++;
+		}
+	}
+	printf("fixSin/fixCos: %s to the old table\n", failures ? "DIFFERENT" : "identical");
+	return failures;
+}
+
+static volatile int sink;
+
+//best of a few tries each, taking turns, so whatever else the machine is up to counts against neither
+#define TRIES 7
+
+//old, then the tightened butterfly on the old table, then as it is now with the quarter table
+static void timeFft(int m, int runs) {
+	static short fr[1024], fi[1024];
+	int n = 1 << m;
+	double best[3] = {1e9, 1e9, 1e9};
+	for (int trial = 0; trial < TRIES * 3; trial++) {
+		int which = trial % 3;
+		rngState = 1;
+		fill(fr, n, 12);
+		fill(fi, n, 12);
+		double start = seconds();
+		for (int r = 0; r < runs; r++)
+			sink += which == 0 ? oldFixFft(fr, fi, m, 0) : which == 1 ? midFixFft(fr, fi, m, 0) : fix_fft(fr, fi, m, 0);
+		double t = (seconds() - start) / runs * 1e9;
+		if (t < best[which])
+			best[which] = t;
+	}
+	printf("  %4d point fft: old %7.0f ns, butterfly %7.0f ns (%+.0f%%), quarter table %7.0f ns (%+.0f%%)\n", n,
+			best[0], best[1], (best[1] / best[0] - 1) * 100, best[2], (best[2] / best[1] - 1) * 100);
+}
+
+int main(int argc, char ** argv) {
+	int rounds = argc > 1 ? atoi(argv[1]) : 2000;
+	int failures = checkFft(rounds) + checkSin();
+	printf("host timings:\n");
+	//the firmware's two, 16 point complex for the low band and 256 for the high
+	timeFft(LOW_NLOG2 - 1, 50000);
+	timeFft(HIGH_NLOG2 - 1, 3000);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,23 @@
+#!/bin/sh
+# Prints how much of the 4K of RAM each statically allocated buffer takes, largest first.
+# Runs as a post-build step from the build directory, or by hand:
+#   tools/ram_report.sh Debug/sensorsRaw.elf
+
+ELF=${1:-sensorsRaw.elf}
+NM=${NM:-arm-none-eabi-nm}
+RAM_START=536870912 # 0x20000000
+RAM_SIZE=4096
+
+SYMBOLS=$($NM -S -t d "$ELF")
+
+#data and bss symbols that live in RAM
+echo "$SYMBOLS" | awk -v start=$RAM_START -v size=$RAM_SIZE '
+	NF == 4 && $1 >= start && $1 < start + size && $3 ~ /^[bBdD]$/ { printf "%6d %s\n", $2, $4 }' | sort -rn
+
+echo "$SYMBOLS" | awk -v start=$RAM_START -v size=$RAM_SIZE '
+	NF == 4 && $1 >= start && $1 < start + size && $3 ~ /^[bBdD]$/ { total += $2 }
+	$NF == "_Min_Stack_Size" { stack = $1 + 0 }
+	END {
+		printf "%6d (stack reserve)\n", stack
+		printf "%6d of %d bytes used, %d free\n", total + stack, size, size - total - stack
+	}'
@@ -0,0 +1,174 @@
+#!/usr/bin/env python3
+# Decodes SD1.0 delta coded frames, and shows how well delta coding would do on a capture of plain frames.
+# A capture is just the raw bytes from the serial port, e.g.:
+#   stty -F /dev/ttyUSB0 115200 raw && head -c 2000000 /dev/ttyUSB0 > music.bin
+#   tools/sd_codec.py stats music.bin    # compression ratio for the SB1.0/SC1.0 frames in it
+#   tools/sd_codec.py decode music.bin   # print the fields of each SD1.0 frame in it
+# Add --cobs for a capture sent with COBS framing (parameter 9 set to 1).
+# Keep this in sync with src/compress.c
+
+import struct
+import sys
+
+KEYFRAME = 0x01
+CHROMA = 0x02
+KEYFRAME_INTERVAL = 32
+FIELDS = {b"SB1.0\0": 44, b"SC1.0\0": 24}
+
+
+def varints(data, pos, count):
+    values = []
+    for _ in range(count):
+        v = shift = 0
+        while True:
+            b = data[pos]
+            pos += 1
+            v |= (b & 0x7F) << shift
+            shift += 7
+            if not b & 0x80:
+                break
+        v &= 0xFFFF
+        values.append(-(v >> 1) - 1 if v & 1 else v >> 1)
+    return values, pos
+
+
+def frame_end(data, pos):
+    """where the SB1.0, SC1.0 or SD1.0 frame at pos ends, not counting END. None if it isn't one, or is cut short"""
+    header = data[pos:pos + 6]
+    if header == b"SD1.0\0":
+        if pos + 9 > len(data):
+            return None
+        flags, count = data[pos + 6], data[pos + 7]
+        try:
+            end = pos + 9 + count * 2 if flags & KEYFRAME else varints(data, pos + 9, count)[1]
+        except IndexError:
+            return None
+    elif header in FIELDS:
+        end = pos + 6 + FIELDS[header] * 2
+    else:
+        return None
+    return end if end <= len(data) else None
+
+
+def plain_frames(data):
+    """yields (header, body) for every frame that ends in END, skipping anything in between"""
+    pos = 0
+    while True:
+        pos = data.find(b"S", pos)
+        if pos < 0 or pos + 6 > len(data):
+            return
+        end = frame_end(data, pos)
+        if end is None or data[end:end + 4] != b"END\0":
+            pos += 1
+            continue
+        yield data[pos:pos + 6], data[pos + 6:end]
+        pos = end + 4
+
+
+def unstuff(block):
+    """undoes COBS, None if the counts don't add up"""
+    out = bytearray()
+    pos = 0
+    while pos < len(block):
+        code = block[pos]
+        if code == 0 or pos + code > len(block):
+            return None
+        out += block[pos + 1:pos + code]
+        pos += code
+        if code < 0xFF and pos < len(block):
+            out.append(0)
+    return bytes(out)
+
+
+def cobs_frames(data):
+    """yields (header, body) for every COBS frame between 0s that decodes to a whole frame, motion and replies are skipped"""
+    for block in data.split(b"\0"):  # one cut off by the start or end of the capture won't add up
+        frame = unstuff(block)
+        if frame is not None and frame_end(frame, 0) == len(frame):
+            yield frame[:6], frame[6:]
+
+
+class Decoder:
+    def __init__(self):
+        self.last = None
+        self.sequence = None
+        self.dropped = 0
+
+    def decode(self, body):
+        """returns the fields as unsigned 16 bit values, or None while waiting for a keyframe"""
+        flags, count, sequence = body[0], body[1], body[2]
+        if self.sequence is not None and sequence != (self.sequence + 1) & 0xFF:
+            self.dropped += 1
+            self.last = None  # a delta against the wrong frame is garbage
+        self.sequence = sequence
+        if flags & KEYFRAME:
+            self.last = list(struct.unpack_from("<%dH" % count, body, 3))
+        elif self.last is not None and len(self.last) == count:
+            deltas = varints(body, 3, count)[0]
+            self.last = [(v + d) & 0xFFFF for v, d in zip(self.last, deltas)]
+        else:
+            self.last = None
+        return self.last
+
+
+def encode_size(fields, last, since_keyframe):
+    """bytes the firmware would send for the fields, not counting the header and END"""
+    if last is None or len(last) != len(fields) or since_keyframe >= KEYFRAME_INTERVAL:
+        return 3 + len(fields) * 2, True
+    size = 0
+    for v, p in zip(fields, last):
+        d = (v - p + 0x8000) % 0x10000 - 0x8000
+        z = ((d << 1) ^ (d >> 15)) & 0xFFFF
+        size += 1 if z < 0x80 else 2 if z < 0x4000 else 3
+    if size > len(fields) * 2:
+        return 3 + len(fields) * 2, True
+    return 3 + size, False
+
+
+def stats(data, cobs):
+    raw = coded = count = keyframes = 0
+    trailer = 2 if cobs else 4  # the COBS code byte and the 0 that ends it, or END
+    last = None
+    since_keyframe = 0
+    for header, body in (cobs_frames if cobs else plain_frames)(data):
+        if header not in FIELDS:
+            continue
+        fields = list(struct.unpack("<%dH" % (len(body) // 2), body))
+        since_keyframe += 1
+        size, keyframe = encode_size(fields, last, since_keyframe)
+        if keyframe:
+            since_keyframe = 0
+            keyframes += 1
+        last = fields
+        raw += 6 + len(body) + trailer
+        coded += 6 + size + trailer
+        count += 1
+    if not count:
+        print("no SB1.0 or SC1.0 frames found")
+        return
+    print("frames:     %d (%d keyframes)" % (count, keyframes))
+    print("raw:        %d bytes, %.1f per frame" % (raw, raw / count))
+    print("delta:      %d bytes, %.1f per frame" % (coded, coded / count))
+    print("ratio:      %.2f, %.0f%% more frames at the same baud rate" % (raw / coded, (raw / coded - 1) * 100))
+
+
+def decode(data, cobs):
+    decoder = Decoder()
+    for header, body in (cobs_frames if cobs else plain_frames)(data):
+        if header != b"SD1.0\0":
+            continue
+        fields = decoder.decode(body)
+        kind = "SC" if body[0] & CHROMA else "SB"
+        print("%3d %s %s" % (body[2], kind, "waiting for keyframe" if fields is None else " ".join(map(str, fields))))
+    if decoder.dropped:
+        print("%d gaps in the sequence" % decoder.dropped, file=sys.stderr)
+
+
+if __name__ == "__main__":
+    args = [a for a in sys.argv[1:] if a != "--cobs"]
+    cobs = len(args) != len(sys.argv) - 1
+    if len(args) != 2 or args[0] not in ("stats", "decode"):
+        sys.exit("usage: %s stats|decode [--cobs] capture.bin" % sys.argv[0])
+    with open(args[1], "rb") as f:
+        data = f.read()
+    stats(data, cobs) if args[0] == "stats" else decode(data, cobs)
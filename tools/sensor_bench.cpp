@@ -0,0 +1,95 @@
+// Throughput of the decoder in sensor_frame.h, on a made up stream of frames with some garbage mixed in.
+//   g++ -O2 -std=c++11 -o sensor_bench tools/sensor_bench.cpp && ./sensor_bench
+// Also a quick check that the decoder finds every frame it should, the counts are printed at the end.
+
+#include "sensor_frame.h"
+
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <vector>
+
+using namespace sensorboard;
+
+static void put16(std::vector<uint8_t> & out, uint16_t v) {
+	out.push_back(v & 0xff);
+	out.push_back(v >> 8);
+}
+
+//COBS the same way output.c does, for frames under 254 bytes
+static void cobs(std::vector<uint8_t> & out, const std::vector<uint8_t> & frame) {
+	size_t code = out.size();
+	out.push_back(0);
+	for (uint8_t c : frame) {
+		if (c == 0) {
+			out[code] = out.size() - code;
+			code = out.size();
+			out.push_back(0);
+		} else {
+			out.push_back(c);
+		}
+	}
+	out[code] = out.size() - code;
+	out.push_back(0);
+}
+
+//a stream of SB1.0 frames with the odd motion frame, and a burst of noise every so often
+static std::vector<uint8_t> makeStream(Framing framing, int frames, int & expected) {
+	std::mt19937 rng(1);
+	std::vector<uint8_t> out, frame;
+	expected = 0;
+	for (int n = 0; n < frames; n++) {
+		frame.clear();
+		bool motion = n % 4 == 3;
+		const char * header = motion ? "SM1.0" : "SB1.0";
+		frame.insert(frame.end(), header, header + 6);
+		for (int i = 0; i < (motion ? MOTION_BYTES / 2 : 44); i++)
+			put16(frame, rng() % 4096);
+		if (framing == FRAMING_PLAIN)
+			frame.insert(frame.end(), "END", "END" + 4);
+		if (n % 50 == 49 && n + 1 < frames) {
+			//cut this one short and follow it with noise, like a dropped byte or a glitch on the wire
+			frame.resize(frame.size() - 10);
+			for (int i = 0; i < 20; i++)
+				frame.push_back(rng());
+		} else {
+			expected++;
+		}
+		if (framing == FRAMING_COBS)
+			cobs(out, frame);
+		else
+			out.insert(out.end(), frame.begin(), frame.end());
+	}
+	return out;
+}
+
+static void run(Framing framing, size_t chunk) {
+	int expected;
+	std::vector<uint8_t> stream = makeStream(framing, 100000, expected);
+	StreamDecoder<> decoder(framing);
+	uint64_t checksum = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	for (size_t pos = 0; pos < stream.size(); pos += chunk) {
+		size_t len = stream.size() - pos < chunk ? stream.size() - pos : chunk;
+		decoder.feed(stream.data() + pos, len, [&](const SensorFrame & frame) {
+			//touch a field so the parse can't be skipped
+			checksum += frame.type == FRAME_BANDS ? frame.band(0) + frame.analog(4) : frame.motionRms();
+		});
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("%-5s chunks of %4zu: %6.1f MB/s %9.0f frames/s  frames %llu/%d bad %llu resyncs %llu skipped %llu (%llu)\n",
+			framing == FRAMING_COBS ? "cobs" : "plain", chunk, stream.size() / seconds / 1e6, decoder.stats.frames / seconds,
+			(unsigned long long) decoder.stats.frames, expected, (unsigned long long) decoder.stats.badFrames,
+			(unsigned long long) decoder.stats.resyncs, (unsigned long long) decoder.stats.skippedBytes,
+			(unsigned long long) (checksum & 0xffff));
+}
+
+int main() {
+	for (Framing framing : {FRAMING_PLAIN, FRAMING_COBS}) {
+		for (size_t chunk : {1, 7, 64, 4096})
+			run(framing, chunk);
+	}
+	return 0;
+}
@@ -0,0 +1,344 @@
+// Records what the sensor board sends, and plays it back later into a virtual serial port, for Linux.
+//   g++ -O2 -std=c++11 -o sensor_capture tools/sensor_capture.cpp
+//
+//   sensor_capture record /dev/ttyUSB0 show.log              everything, exactly as it came in
+//   sensor_capture record --frames /dev/ttyUSB0 show.log     just the good frames, garbage dropped
+//   sensor_capture replay show.log                           at the speed it was recorded
+//   sensor_capture replay --speed 10 show.log                10x, or --max for as fast as it's read
+//   sensor_capture dump show.log                             what's in it
+//
+// record stops on ctrl-c. --baud sets the rate (115200 by default), --cobs decodes COBS framing for --frames.
+// replay makes a pty and prints its name, point the receiver being tested at that. --link also makes a
+// symlink to it with a fixed name. -- given as the device records stdin instead.
+//
+// The log is "SBLOG1\0" then one record per chunk read or frame decoded: microseconds since the previous
+// record and the byte count, both as varints, then the bytes. Frames are stored as plain "END" frames.
+// It's written as it goes and read back with mmap, so hours of capture never have to fit in memory.
+
+#include "sensor_frame.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace sensorboard;
+
+static const char logMagic[] = "SBLOG1";
+
+static volatile sig_atomic_t stopping;
+
+static uint64_t nowUs() {
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t) t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+static void putVarint(FILE * f, uint64_t v) {
+	while (v >= 0x80) {
+		fputc((int) (v & 0x7f) | 0x80, f);
+		v >>= 7;
+	}
+	fputc((int) v, f);
+}
+
+static bool getVarint(const uint8_t *& p, const uint8_t * end, uint64_t & v) {
+	v = 0;
+	for (int shift = 0; p < end && shift < 64; shift += 7) {
+		uint8_t b = *p++;
+		v |= (uint64_t) (b & 0x7f) << shift;
+		if (!(b & 0x80))
+			return true;
+	}
+	return false;
+}
+
+static speed_t baudConstant(long baud) {
+	switch (baud) {
+	case 9600: return B9600;
+	case 19200: return B19200;
+	case 38400: return B38400;
+	case 57600: return B57600;
+	case 115200: return B115200;
+	case 230400: return B230400;
+	case 460800: return B460800;
+	case 921600: return B921600;
+	case 1000000: return B1000000;
+	case 1500000: return B1500000;
+	case 2000000: return B2000000;
+	case 3000000: return B3000000;
+	default: return 0;
+	}
+}
+
+static void writeRecord(FILE * log, uint64_t & lastUs, const uint8_t * data, size_t len) {
+	uint64_t now = nowUs();
+	putVarint(log, now - lastUs);
+	putVarint(log, len);
+	fwrite(data, 1, len, log);
+	lastUs = now;
+}
+
+//puts a decoded frame back together the way it looks on the wire without COBS
+static size_t rebuildFrame(const SensorFrame & frame, uint8_t * out) {
+	size_t len = 0;
+	memcpy(out, "S?1.0", 6);
+	out[1] = frame.type;
+	len = 6;
+	if (frame.type == FRAME_PROFILE)
+		out[len++] = frame.fields;
+	memcpy(out + len, frame.body, frame.size);
+	len += frame.size;
+	memcpy(out + len, "END", 4);
+	return len + 4;
+}
+
+static int record(const char * device, const char * path, long baud, bool frames, Framing framing) {
+	int fd = STDIN_FILENO;
+	if (strcmp(device, "--") != 0) {
+		fd = open(device, O_RDONLY | O_NOCTTY);
+		if (fd < 0) {
+			perror(device);
+			return 1;
+		}
+		speed_t speed = baudConstant(baud);
+		termios tty;
+		if (!speed || tcgetattr(fd, &tty) != 0) {
+			fprintf(stderr, "%s: can't set %ld baud\n", device, baud);
+			return 1;
+		}
+		cfmakeraw(&tty);
+		cfsetispeed(&tty, speed);
+		cfsetospeed(&tty, speed);
+		tty.c_cc[VMIN] = 1;
+		tty.c_cc[VTIME] = 0;
+		tcsetattr(fd, TCSANOW, &tty);
+	}
+	FILE * log = fopen(path, "wb");
+	if (!log) {
+		perror(path);
+		return 1;
+	}
+	fwrite(logMagic, 1, sizeof(logMagic), log);
+
+	StreamDecoder<> decoder(framing);
+	uint64_t lastUs = nowUs(), bytes = 0;
+	uint8_t buf[4096], frameBuf[256];
+	while (!stopping) {
+		ssize_t n = read(fd, buf, sizeof(buf));
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		bytes += n;
+		if (!frames) {
+			writeRecord(log, lastUs, buf, n);
+			continue;
+		}
+		decoder.feed(buf, n, [&](const SensorFrame & frame) {
+			writeRecord(log, lastUs, frameBuf, rebuildFrame(frame, frameBuf));
+		});
+	}
+	fclose(log);
+	fprintf(stderr, "%llu bytes read", (unsigned long long) bytes);
+	if (frames)
+		fprintf(stderr, ", %llu frames kept, %llu bad, %llu resyncs", (unsigned long long) decoder.stats.frames,
+				(unsigned long long) decoder.stats.badFrames, (unsigned long long) decoder.stats.resyncs);
+	fprintf(stderr, "\n");
+	return 0;
+}
+
+//the log, mapped in. records are read straight out of it
+struct LogFile {
+	const uint8_t * data = nullptr;
+	size_t size = 0;
+
+	bool open(const char * path) {
+		int fd = ::open(path, O_RDONLY);
+		struct stat st;
+		if (fd < 0 || fstat(fd, &st) != 0) {
+			perror(path);
+			return false;
+		}
+		size = st.st_size;
+		if (size < sizeof(logMagic) || (data = (const uint8_t *) mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+			fprintf(stderr, "%s: can't read it\n", path);
+			close(fd);
+			return false;
+		}
+		close(fd);
+		if (memcmp(data, logMagic, sizeof(logMagic)) != 0) {
+			fprintf(stderr, "%s: not a capture\n", path);
+			return false;
+		}
+		//it's read front to back once, let the kernel read ahead and drop pages behind
+		madvise((void *) data, size, MADV_SEQUENTIAL);
+		return true;
+	}
+
+	//calls onRecord(delayUs, bytes, len) for each record, stops early if it returns false
+	template <typename F>
+	bool each(F && onRecord) const {
+		const uint8_t * p = data + sizeof(logMagic), * end = data + size;
+		while (p < end) {
+			uint64_t delay, len;
+			if (!getVarint(p, end, delay) || !getVarint(p, end, len) || len > (uint64_t) (end - p)) {
+				fprintf(stderr, "capture is cut short\n");
+				return false;
+			}
+			if (!onRecord(delay, p, (size_t) len))
+				return true;
+			p += len;
+		}
+		return true;
+	}
+};
+
+static int replay(const char * path, double speed, const char * link) {
+	LogFile log;
+	if (!log.open(path))
+		return 1;
+
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+		perror("pty");
+		return 1;
+	}
+	const char * name = ptsname(master);
+	//keep the other end open too, so the receiver can come and go, and make it raw so bytes go through untouched
+	int slave = open(name, O_RDWR | O_NOCTTY);
+	termios tty;
+	tcgetattr(slave, &tty);
+	cfmakeraw(&tty);
+	tcsetattr(slave, TCSANOW, &tty);
+	if (link) {
+		unlink(link);
+		if (symlink(name, link) != 0)
+			perror(link);
+	}
+	printf("%s\n", link ? link : name);
+	fflush(stdout);
+
+	uint64_t due = nowUs(), bytes = 0;
+	bool ok = log.each([&](uint64_t delayUs, const uint8_t * data, size_t len) {
+		if (speed > 0) {
+			due += (uint64_t) (delayUs / speed);
+			uint64_t now = nowUs();
+			if (due > now)
+				usleep(due - now);
+		}
+		while (len && !stopping) {
+			ssize_t n = write(master, data, len);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n < 0)
+				return false;
+			data += n;
+			len -= n;
+			bytes += n;
+		}
+		return !stopping;
+	});
+	fprintf(stderr, "%llu bytes replayed\n", (unsigned long long) bytes);
+	//anything the receiver hasn't read yet is thrown away when the pty closes, give it a chance
+	int waiting;
+	while (!stopping && ioctl(slave, FIONREAD, &waiting) == 0 && waiting > 0)
+		usleep(10000);
+	if (link)
+		unlink(link);
+	close(slave);
+	close(master);
+	return ok ? 0 : 1;
+}
+
+static int dump(const char * path, Framing framing) {
+	LogFile log;
+	if (!log.open(path))
+		return 1;
+	StreamDecoder<> decoder(framing);
+	DeltaDecoder delta;
+	uint64_t records = 0, bytes = 0, us = 0, counts[256] = {0};
+	bool ok = log.each([&](uint64_t delayUs, const uint8_t * data, size_t len) {
+		records++;
+		bytes += len;
+		us += delayUs;
+		decoder.feed(data, len, [&](const SensorFrame & frame) {
+			counts[frame.type]++;
+			SensorFrame decoded;
+			if (frame.type == FRAME_DELTA)
+				delta.decode(frame, decoded);
+		});
+		return true;
+	});
+	printf("%llu records, %llu bytes over %.1f seconds\n", (unsigned long long) records, (unsigned long long) bytes, us / 1e6);
+	for (int type = 0; type < 256; type++) {
+		if (counts[type])
+			printf("S%c1.0: %llu frames, %.1f per second\n", type, (unsigned long long) counts[type], us ? counts[type] * 1e6 / us : 0);
+	}
+	printf("%llu bad frames, %llu resyncs, %llu bytes skipped, %llu delta frames lost to gaps\n",
+			(unsigned long long) decoder.stats.badFrames, (unsigned long long) decoder.stats.resyncs,
+			(unsigned long long) decoder.stats.skippedBytes, (unsigned long long) delta.gaps);
+	return ok ? 0 : 1;
+}
+
+static void usage() {
+	fprintf(stderr, "usage: sensor_capture record [--frames] [--cobs] [--baud N] device|-- capture.log\n"
+			"       sensor_capture replay [--speed N | --max] [--link path] capture.log\n"
+			"       sensor_capture dump [--cobs] capture.log\n");
+	exit(2);
+}
+
+int main(int argc, char ** argv) {
+	if (argc < 2)
+		usage();
+	const char * command = argv[1];
+	bool frames = false;
+	Framing framing = FRAMING_PLAIN;
+	long baud = 115200;
+	double speed = 1;
+	const char * link = nullptr;
+	const char * args[2];
+	int argCount = 0;
+	for (int i = 2; i < argc; i++) {
+		const char * a = argv[i];
+		if (!strcmp(a, "--frames"))
+			frames = true;
+		else if (!strcmp(a, "--cobs"))
+			framing = FRAMING_COBS;
+		else if (!strcmp(a, "--max"))
+			speed = 0;
+		else if (!strcmp(a, "--baud") && i + 1 < argc)
+			baud = atol(argv[++i]);
+		else if (!strcmp(a, "--speed") && i + 1 < argc)
+			speed = atof(argv[++i]);
+		else if (!strcmp(a, "--link") && i + 1 < argc)
+			link = argv[++i];
+		else if (argCount < 2 && (a[0] != '-' || !strcmp(a, "--")))
+			args[argCount++] = a;
+		else
+			usage();
+	}
+
+	struct sigaction sa = {};
+	sa.sa_handler = [](int) { stopping = 1; };
+	sigaction(SIGINT, &sa, nullptr);
+	sigaction(SIGTERM, &sa, nullptr);
+	signal(SIGPIPE, SIG_IGN);
+
+	if (!strcmp(command, "record") && argCount == 2)
+		return record(args[0], args[1], baud, frames, framing);
+	if (!strcmp(command, "replay") && argCount == 1 && speed >= 0)
+		return replay(args[0], speed, link);
+	if (!strcmp(command, "dump") && argCount == 1)
+		return dump(args[0], framing);
+	usage();
+	return 2;
+}
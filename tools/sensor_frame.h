@@ -0,0 +1,507 @@
+// Header only decoder for the sensor board's serial frames, for hosts and bigger microcontrollers.
+// Covers everything in the README: "SB1.0", "SC1.0", "SP1.0" profile frames, "SM1.0" motion frames,
+// "SR1.0" command replies and "SD1.0" delta coded frames, with either plain or COBS framing.
+// Needs C++11 and nothing else, no heap and no exceptions, so it also builds for a Teensy.
+//
+// A SensorFrame is a view, not a copy, and is only good until the next call into the decoder. Fields are
+// read out as they're asked for. With plain framing, frames that arrive whole are parsed right where they
+// are, and only a frame split across reads is copied into the decoder. COBS frames are always decoded into
+// the decoder's buffer, so the view points there.
+//
+//   sensorboard::StreamDecoder<> decoder;
+//   decoder.feed(bytes, count, [](const sensorboard::SensorFrame & frame) {
+//       if (frame.bandCount())
+//           printf("%u\n", frame.band(0));
+//   });
+//
+// Keep this in sync with output.c, motion.c and command.c in the firmware.
+
+#ifndef SENSORBOARD_SENSOR_FRAME_H
+#define SENSORBOARD_SENSOR_FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace sensorboard {
+
+//the second letter of the header
+enum FrameType : uint8_t {
+	FRAME_NONE = 0,
+	FRAME_BANDS = 'B', //"SB1.0", 32 bands and everything else
+	FRAME_CHROMA = 'C', //"SC1.0", 12 pitch classes and everything else
+	FRAME_PROFILE = 'P', //"SP1.0", a field mask then those fields
+	FRAME_DELTA = 'D', //"SD1.0", see DeltaDecoder
+	FRAME_MOTION = 'M', //"SM1.0"
+	FRAME_REPLY = 'R', //"SR1.0"
+};
+
+//which fields a frame has, in the order they come in, same as FIELD_* in main.h
+enum : uint8_t {
+	FIELD_BANDS = 0x01, //32 x uint16_t
+	FIELD_CHROMA = 0x02, //12 x uint16_t
+	FIELD_ENERGY = 0x04, //energy average, max frequency magnitude, max frequency Hz
+	FIELD_ACCEL = 0x08, //3 x int16_t
+	FIELD_LIGHT = 0x10, //uint16_t
+	FIELD_ANALOG = 0x20, //5 x uint16_t
+	FIELD_ALL = 0x3f,
+};
+
+enum Framing : uint8_t {
+	FRAMING_PLAIN, //each frame ends in "END"
+	FRAMING_COBS, //each frame is COBS encoded and ends in a 0
+};
+
+enum : uint8_t {
+	DELTA_KEYFRAME = 0x01,
+	DELTA_CHROMA = 0x02,
+	DELTA_MAX_FIELDS = 44,
+	REPLY_MAX_DATA = 32,
+	MOTION_BYTES = 40,
+};
+
+inline uint16_t readU16(const uint8_t * p) {
+	return (uint16_t) (p[0] | p[1] << 8);
+}
+
+inline int fieldBytes(uint8_t field) {
+	switch (field) {
+	case FIELD_BANDS: return 64;
+	case FIELD_CHROMA: return 24;
+	case FIELD_ENERGY: return 6;
+	case FIELD_ACCEL: return 6;
+	case FIELD_LIGHT: return 2;
+	case FIELD_ANALOG: return 10;
+	default: return 0;
+	}
+}
+
+//bytes taken by all the fields in a mask
+inline int fieldsBytes(uint8_t fields) {
+	int total = 0;
+	for (uint8_t f = 1; f & FIELD_ALL; f <<= 1)
+		if (fields & f)
+			total += fieldBytes(f);
+	return total;
+}
+
+//a view of one frame, body is everything after the header (and after the mask for "SP1.0") up to the end
+struct SensorFrame {
+	FrameType type = FRAME_NONE;
+	uint8_t fields = 0; //FIELD_* for sensor frames, 0 for the rest
+	const uint8_t * body = nullptr;
+	size_t size = 0;
+
+	bool has(uint8_t field) const {
+		return fields & field;
+	}
+
+	//where a field starts in the body
+	int offset(uint8_t field) const {
+		return fieldsBytes(fields & (field - 1));
+	}
+
+	//bands or chroma, whichever is there
+	int bandCount() const {
+		return has(FIELD_BANDS) ? 32 : has(FIELD_CHROMA) ? 12 : 0;
+	}
+	uint16_t band(int i) const {
+		return readU16(body + i * 2);
+	}
+	uint16_t energyAverage() const {
+		return readU16(body + offset(FIELD_ENERGY));
+	}
+	uint16_t maxFrequencyMagnitude() const {
+		return readU16(body + offset(FIELD_ENERGY) + 2);
+	}
+	uint16_t maxFrequencyHz() const {
+		return readU16(body + offset(FIELD_ENERGY) + 4);
+	}
+	int16_t accel(int axis) const {
+		return (int16_t) readU16(body + offset(FIELD_ACCEL) + axis * 2);
+	}
+	uint16_t light() const {
+		return readU16(body + offset(FIELD_LIGHT));
+	}
+	uint16_t analog(int i) const {
+		return readU16(body + offset(FIELD_ANALOG) + i * 2);
+	}
+
+	//FRAME_MOTION
+	int16_t motionMean(int axis) const { return (int16_t) readU16(body + axis * 2); }
+	uint16_t motionPeak(int axis) const { return readU16(body + 6 + axis * 2); }
+	uint16_t motionRms() const { return readU16(body + 12); }
+	uint16_t motionJerk() const { return readU16(body + 14); }
+	uint16_t motionSamples() const { return readU16(body + 16); }
+	uint16_t motionSampleMs() const { return readU16(body + 18); }
+	uint16_t motionShake() const { return readU16(body + 20); }
+	int16_t motionPitch() const { return (int16_t) readU16(body + 22); }
+	int16_t motionRoll() const { return (int16_t) readU16(body + 24); }
+	uint8_t motionOrientation() const { return body[26]; }
+	uint8_t motionEvents() const { return body[27]; }
+	uint16_t motionEventMs(int event) const { return readU16(body + 28 + event * 2); }
+	uint16_t motionNowMs() const { return readU16(body + 38); }
+
+	//FRAME_REPLY
+	uint8_t replyCommand() const { return body[0]; }
+	uint8_t replyStatus() const { return body[1]; }
+	uint8_t replyLength() const { return body[2]; }
+	const uint8_t * replyData() const { return body + 3; }
+
+	//FRAME_DELTA, the fields need a DeltaDecoder
+	uint8_t deltaFlags() const { return body[0]; }
+	uint8_t deltaCount() const { return body[1]; }
+	uint8_t deltaSequence() const { return body[2]; }
+};
+
+enum ParseResult {
+	PARSE_OK,
+	PARSE_NEED_MORE, //could be a frame, the rest hasn't come in yet
+	PARSE_BAD, //not a frame, or one that doesn't add up
+};
+
+//bytes of zigzag varints for count values, -1 if they run past len, -2 if one is too long to be real
+inline int varintsBytes(const uint8_t * p, size_t len, int count) {
+	size_t i = 0;
+	for (int n = 0; n < count; n++) {
+		for (int b = 0;; b++) {
+			if (i >= len)
+				return -1;
+			if (b == 2 && (p[i] & 0x80))
+				return -2; //16 bit values never take more than 3 bytes
+			if (!(p[i++] & 0x80))
+				break;
+		}
+	}
+	return (int) i;
+}
+
+/*
+ * Works out what's in a frame. data starts at the header and has len bytes available
+ * with hasEnd the frame has to end in "END", otherwise (COBS) len has to be exactly the frame
+ * on PARSE_OK frameLen is how many bytes the frame took, including "END"
+ * on PARSE_NEED_MORE it's the least the frame could take, there's no point trying again with fewer
+ */
+inline ParseResult parseFrame(const uint8_t * data, size_t len, bool hasEnd, SensorFrame & frame, size_t & frameLen) {
+	frameLen = 6;
+	if (len < 6)
+		return hasEnd && (len == 0 || data[0] == 'S') ? PARSE_NEED_MORE : PARSE_BAD;
+	if (data[0] != 'S' || memcmp(data + 2, "1.0", 4) != 0)
+		return PARSE_BAD;
+
+	frame.type = (FrameType) data[1];
+	frame.fields = 0;
+	size_t head = 6;
+	long body; //bytes between the header and "END"
+	switch (frame.type) {
+	case FRAME_BANDS:
+		frame.fields = FIELD_ALL & ~FIELD_CHROMA;
+		body = fieldsBytes(frame.fields);
+		break;
+	case FRAME_CHROMA:
+		frame.fields = FIELD_ALL & ~FIELD_BANDS;
+		body = fieldsBytes(frame.fields);
+		break;
+	case FRAME_PROFILE:
+		frameLen = 7;
+		if (len < 7)
+			return hasEnd ? PARSE_NEED_MORE : PARSE_BAD;
+		frame.fields = data[6];
+		//fields this doesn't know about can't be skipped over
+		if ((frame.fields & ~FIELD_ALL) || (frame.fields & FIELD_BANDS && frame.fields & FIELD_CHROMA))
+			return PARSE_BAD;
+		head = 7;
+		body = fieldsBytes(frame.fields);
+		break;
+	case FRAME_MOTION:
+		body = MOTION_BYTES;
+		break;
+	case FRAME_REPLY:
+		frameLen = 9;
+		if (len < 9)
+			return hasEnd ? PARSE_NEED_MORE : PARSE_BAD;
+		if (data[8] > REPLY_MAX_DATA)
+			return PARSE_BAD;
+		body = 3 + data[8];
+		break;
+	case FRAME_DELTA: {
+		frameLen = 9;
+		if (len < 9)
+			return hasEnd ? PARSE_NEED_MORE : PARSE_BAD;
+		int count = data[7];
+		if (count > DELTA_MAX_FIELDS)
+			return PARSE_BAD;
+		if (data[6] & DELTA_KEYFRAME) {
+			body = 3 + count * 2;
+		} else {
+			int n = varintsBytes(data + 9, len - 9, count);
+			if (n == -2)
+				return PARSE_BAD;
+			frameLen = len + 1;
+			if (n < 0)
+				return hasEnd ? PARSE_NEED_MORE : PARSE_BAD;
+			body = 3 + n;
+		}
+		break;
+	}
+	default:
+		return PARSE_BAD;
+	}
+
+	size_t total = head + body + (hasEnd ? 4 : 0);
+	frameLen = total;
+	if (len < total)
+		return hasEnd ? PARSE_NEED_MORE : PARSE_BAD;
+	if (hasEnd ? memcmp(data + head + body, "END", 4) != 0 : len != total)
+		return PARSE_BAD;
+	frame.body = data + head;
+	frame.size = body;
+	frameLen = total;
+	return PARSE_OK;
+}
+
+struct DecoderStats {
+	uint64_t frames = 0; //good frames handed out
+	uint64_t badFrames = 0; //looked like the start of a frame but didn't add up
+	uint64_t resyncs = 0; //times bytes had to be skipped to find the next frame
+	uint64_t skippedBytes = 0;
+};
+
+/*
+ * Pulls frames out of a stream of bytes, whatever size the pieces come in
+ * plain frames that arrive whole in one call to feed() are parsed right where they are, only a frame split
+ * across calls gets copied into the decoder's buffer. COBS frames are all decoded into the buffer
+ * BufferSize has to fit the biggest frame
+ */
+template <size_t BufferSize = 256>
+class StreamDecoder {
+	//a delta frame can run to 9 + 44 * 3 + 4 bytes
+	static_assert(BufferSize >= 160, "the buffer has to fit the biggest frame");
+
+public:
+	DecoderStats stats;
+
+	explicit StreamDecoder(Framing framing = FRAMING_PLAIN) : framing(framing) {}
+
+	//calls onFrame(const SensorFrame &) for each frame, the frame points into data or the decoder's buffer
+	template <typename F>
+	void feed(const uint8_t * data, size_t len, F && onFrame) {
+		if (framing == FRAMING_COBS) {
+			for (size_t i = 0; i < len; i++)
+				feedCobs(data[i], onFrame);
+			return;
+		}
+		while (len) {
+			if (bufStart == bufLen) {
+				size_t used = scan(data, len, onFrame);
+				//keep whatever's left of a frame that isn't all here yet
+				memcpy(buf, data + used, len - used);
+				bufStart = 0;
+				bufLen = len - used;
+				return;
+			}
+			//not enough yet for the frame that's waiting to be worth another look
+			if (bufLen - bufStart + len < need && bufLen + len <= BufferSize) {
+				memcpy(buf + bufLen, data, len);
+				bufLen += len;
+				return;
+			}
+			//only move what's waiting to the front once there's no more room after it
+			if (bufLen == BufferSize) {
+				if (!bufStart) {
+					//can't be a frame that big
+					skip(1);
+					bufStart = 1;
+				}
+				memmove(buf, buf + bufStart, bufLen - bufStart);
+				bufLen -= bufStart;
+				bufStart = 0;
+			}
+			//top up the buffer to finish off the frame that's waiting
+			size_t old = bufLen;
+			size_t add = len < BufferSize - bufLen ? len : BufferSize - bufLen;
+			memcpy(buf + bufLen, data, add);
+			bufLen += add;
+			bufStart += scan(buf + bufStart, bufLen - bufStart, onFrame);
+			if (bufStart >= old) {
+				//all caught up, the rest can be parsed straight from data
+				data += bufStart - old;
+				len -= bufStart - old;
+				bufStart = bufLen = 0;
+			} else {
+				data += add;
+				len -= add;
+			}
+		}
+	}
+
+	void reset() {
+		bufStart = bufLen = need = 0;
+		cobsCode = 0;
+		cobsDropping = false;
+		skipping = false;
+	}
+
+private:
+	Framing framing;
+	uint8_t buf[BufferSize];
+	size_t bufLen = 0;
+	size_t bufStart = 0; //plain framing, where the frame that's waiting starts in buf
+	size_t need = 0; //and the least it could take, from the last look at it
+	bool skipping = false; //in the middle of some garbage
+	uint8_t cobsCode = 0; //bytes until the next 0 goes in, 0 at the start of a frame
+	bool cobsBlockFull = false; //the last code was 255, no 0 goes in after it
+	bool cobsDropping = false; //something was wrong, ignore everything up to the next 0
+
+	void skip(size_t n) {
+		if (!skipping)
+			stats.resyncs++;
+		skipping = true;
+		stats.skippedBytes += n;
+	}
+
+	//returns how much of p was used up, anything after that could still be the start of a frame
+	template <typename F>
+	size_t scan(const uint8_t * p, size_t len, F & onFrame) {
+		size_t pos = 0;
+		while (pos < len) {
+			if (p[pos] != 'S') {
+				const uint8_t * s = (const uint8_t *) memchr(p + pos, 'S', len - pos);
+				size_t next = s ? s - p : len;
+				skip(next - pos);
+				pos = next;
+				continue;
+			}
+			SensorFrame frame;
+			size_t frameLen;
+			switch (parseFrame(p + pos, len - pos, true, frame, frameLen)) {
+			case PARSE_OK:
+				stats.frames++;
+				skipping = false;
+				onFrame(frame);
+				pos += frameLen;
+				break;
+			case PARSE_NEED_MORE:
+				need = frameLen;
+				return pos;
+			case PARSE_BAD:
+				//only count it as a bad frame if the header was right
+				if (len - pos >= 6 && memcmp(p + pos + 2, "1.0", 4) == 0)
+					stats.badFrames++;
+				skip(1);
+				pos++;
+				break;
+			}
+		}
+		return pos;
+	}
+
+	//COBS one byte at a time, decoded into buf
+	template <typename F>
+	void feedCobs(uint8_t c, F & onFrame) {
+		if (c == 0) {
+			if (!cobsDropping && bufLen) {
+				SensorFrame frame;
+				size_t frameLen;
+				if (cobsCode == 1 && parseFrame(buf, bufLen, false, frame, frameLen) == PARSE_OK) {
+					stats.frames++;
+					skipping = false;
+					onFrame(frame);
+				} else {
+					stats.badFrames++;
+					skip(bufLen);
+				}
+			} else if (cobsDropping) {
+				skip(bufLen);
+			}
+			bufLen = 0;
+			cobsCode = 0;
+			cobsDropping = false;
+			return;
+		}
+		if (cobsDropping)
+			return;
+		if (bufLen >= BufferSize) {
+			cobsDropping = true;
+			stats.badFrames++;
+			return;
+		}
+		if (cobsCode == 0) {
+			//first byte of the frame
+			cobsCode = c;
+			cobsBlockFull = c == 255;
+			return;
+		}
+		if (--cobsCode == 0) {
+			//this is a code, the 0 it stands for goes in first
+			if (!cobsBlockFull)
+				buf[bufLen++] = 0;
+			cobsCode = c;
+			cobsBlockFull = c == 255;
+			return;
+		}
+		buf[bufLen++] = c;
+	}
+};
+
+/*
+ * Turns "SD1.0" frames back into the "SB1.0" or "SC1.0" they were made from
+ * waits for a keyframe to start with, and again after a frame goes missing
+ */
+class DeltaDecoder {
+public:
+	uint64_t gaps = 0; //times the sequence number skipped
+
+	//on success out is a view of the decoded frame, good until the next call
+	bool decode(const SensorFrame & delta, SensorFrame & out) {
+		if (delta.type != FRAME_DELTA)
+			return false;
+		uint8_t flags = delta.deltaFlags(), count = delta.deltaCount(), sequence = delta.deltaSequence();
+		if (haveSequence && sequence != (uint8_t) (lastSequence + 1)) {
+			gaps++;
+			valid = false;
+		}
+		haveSequence = true;
+		lastSequence = sequence;
+		const uint8_t * p = delta.body + 3;
+		if (flags & DELTA_KEYFRAME) {
+			memcpy(values, p, count * 2);
+			valid = true;
+		} else if (!valid || count != lastCount || (flags & DELTA_CHROMA) != (lastFlags & DELTA_CHROMA)) {
+			valid = false;
+		} else {
+			for (int i = 0; i < count; i++) {
+				uint32_t z = 0;
+				for (int shift = 0;; shift += 7) {
+					uint8_t b = *p++;
+					z |= (uint32_t) (b & 0x7f) << shift;
+					if (!(b & 0x80))
+						break;
+				}
+				z &= 0xffff;
+				int delta16 = z & 1 ? -(int) (z >> 1) - 1 : (int) (z >> 1);
+				uint16_t v = (uint16_t) (readU16(values + i * 2) + delta16);
+				values[i * 2] = v & 0xff;
+				values[i * 2 + 1] = v >> 8;
+			}
+		}
+		lastCount = count;
+		lastFlags = flags;
+		if (!valid)
+			return false;
+		out.type = flags & DELTA_CHROMA ? FRAME_CHROMA : FRAME_BANDS;
+		out.fields = FIELD_ALL & ~(flags & DELTA_CHROMA ? FIELD_BANDS : FIELD_CHROMA);
+		out.body = values;
+		out.size = count * 2;
+		return (int) out.size == fieldsBytes(out.fields);
+	}
+
+private:
+	uint8_t values[DELTA_MAX_FIELDS * 2];
+	uint8_t lastCount = 0, lastFlags = 0, lastSequence = 0;
+	bool haveSequence = false, valid = false;
+};
+
+} // namespace sensorboard
+
+#endif
@@ -0,0 +1,392 @@
+// Fuzzing for the decoder in sensor_frame.h, parseFrame, StreamDecoder with both framings and DeltaDecoder.
+// With gcc it runs its own loop, mutating a stream of good frames at random:
+//   g++ -std=c++11 -g -O1 -fsanitize=address,undefined -fno-sanitize-recover=all -o sensor_fuzz tools/sensor_fuzz.cpp
+//   ./sensor_fuzz [iterations] [seed]
+// or as a libFuzzer target with clang:
+//   clang++ -std=c++11 -g -O1 -fsanitize=fuzzer,address,undefined -DSENSOR_FUZZ_LIBFUZZER -o sensor_fuzz tools/sensor_fuzz.cpp
+// As well as the sanitizers catching reads past the end, it checks that:
+//   every frame handed out parses again on its own, and all its fields can be read
+//   feeding the stream in random sized pieces finds exactly the frames feeding it all at once does
+//   those frames come back out the same after going through COBS
+//   delta frames made the way compress.c makes them decode back to what went in, missing ones included
+
+#include "sensor_frame.h"
+
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+using namespace sensorboard;
+
+static void check(bool ok, const char * what) {
+	if (!ok) {
+		fprintf(stderr, "failed: %s\n", what);
+		abort();
+	}
+}
+
+//COBS the same way output.c does, for frames under 254 bytes
+static void cobs(std::vector<uint8_t> & out, const std::vector<uint8_t> & frame) {
+	size_t code = out.size();
+	out.push_back(0);
+	for (uint8_t c : frame) {
+		if (c == 0) {
+			out[code] = out.size() - code;
+			code = out.size();
+			out.push_back(0);
+		} else {
+			out.push_back(c);
+		}
+	}
+	out[code] = out.size() - code;
+	out.push_back(0);
+}
+
+//a frame put back together from a view, as it was sent with plain framing
+static std::vector<uint8_t> rebuild(const SensorFrame & frame) {
+	std::vector<uint8_t> out = {'S', (uint8_t) frame.type, '1', '.', '0', 0};
+	if (frame.type == FRAME_PROFILE)
+		out.push_back(frame.fields);
+	out.insert(out.end(), frame.body, frame.body + frame.size);
+	out.insert(out.end(), {'E', 'N', 'D', 0});
+	return out;
+}
+
+static volatile uint32_t sink;
+
+//reads everything the frame says it has, so the sanitizers see any of it that's out of bounds
+static void readAll(const SensorFrame & frame) {
+	uint32_t sum = 0;
+	switch (frame.type) {
+	case FRAME_BANDS:
+	case FRAME_CHROMA:
+	case FRAME_PROFILE:
+		check((int) frame.size == fieldsBytes(frame.fields), "sensor frame size matches its fields");
+		for (int i = 0; i < frame.bandCount(); i++)
+			sum += frame.band(i);
+		if (frame.has(FIELD_ENERGY))
+			sum += frame.energyAverage() + frame.maxFrequencyMagnitude() + frame.maxFrequencyHz();
+		if (frame.has(FIELD_ACCEL))
+			sum += frame.accel(0) + frame.accel(1) + frame.accel(2);
+		if (frame.has(FIELD_LIGHT))
+			sum += frame.light();
+		if (frame.has(FIELD_ANALOG))
+			for (int i = 0; i < 5; i++)
+				sum += frame.analog(i);
+		break;
+	case FRAME_MOTION:
+		check(frame.size == MOTION_BYTES, "motion frame size");
+		for (int axis = 0; axis < 3; axis++)
+			sum += frame.motionMean(axis) + frame.motionPeak(axis);
+		sum += frame.motionRms() + frame.motionJerk() + frame.motionSamples() + frame.motionSampleMs();
+		sum += frame.motionShake() + frame.motionPitch() + frame.motionRoll();
+		sum += frame.motionOrientation() + frame.motionEvents() + frame.motionNowMs();
+		for (int event = 0; event < 5; event++)
+			sum += frame.motionEventMs(event);
+		break;
+	case FRAME_REPLY:
+		check(frame.size == 3u + frame.replyLength(), "reply size matches its length");
+		sum += frame.replyCommand() + frame.replyStatus();
+		for (int i = 0; i < frame.replyLength(); i++)
+			sum += frame.replyData()[i];
+		break;
+	case FRAME_DELTA:
+		check(frame.size >= 3, "delta frame has its flags, count and sequence");
+		sum += frame.deltaFlags() + frame.deltaCount() + frame.deltaSequence();
+		break;
+	default:
+		check(false, "frame type is one parseFrame knows");
+	}
+	sink = sum;
+}
+
+//parseFrame on exactly the bytes given, copied to the heap so reading one past the end gets caught
+static void fuzzParse(const uint8_t * data, size_t len) {
+	std::vector<uint8_t> copy(data, data + len);
+	for (bool hasEnd : {true, false}) {
+		SensorFrame frame;
+		size_t frameLen;
+		//an empty vector's data() can be null, parseFrame has to cope without reading it
+		ParseResult r = parseFrame(len ? copy.data() : nullptr, len, hasEnd, frame, frameLen);
+		if (r == PARSE_OK) {
+			check(frameLen <= len && (hasEnd || frameLen == len), "frame fits in what it was given");
+			readAll(frame);
+			DeltaDecoder delta;
+			SensorFrame decoded;
+			if (delta.decode(frame, decoded))
+				readAll(decoded);
+		} else if (r == PARSE_NEED_MORE) {
+			check(hasEnd && frameLen > len, "needing more means more than there is");
+		}
+	}
+}
+
+struct Found {
+	std::vector<uint8_t> bytes;
+	bool operator==(const Found & o) const { return bytes == o.bytes; }
+};
+
+template <typename Decoder>
+static void collect(Decoder & decoder, const uint8_t * data, size_t len, std::vector<Found> & found) {
+	decoder.feed(data, len, [&](const SensorFrame & frame) {
+		readAll(frame);
+		//it has to stand up on its own too
+		std::vector<uint8_t> bytes = rebuild(frame);
+		SensorFrame again;
+		size_t frameLen;
+		check(parseFrame(bytes.data(), bytes.size(), true, again, frameLen) == PARSE_OK && frameLen == bytes.size(),
+				"a frame handed out parses again");
+		found.push_back({bytes});
+	});
+}
+
+//the same bytes fed all at once and in random pieces, which have to find the same frames
+static std::vector<Found> fuzzStream(Framing framing, const std::vector<uint8_t> & stream, std::minstd_rand & rng) {
+	std::vector<Found> whole, pieces;
+	StreamDecoder<> all(framing);
+	collect(all, stream.data(), stream.size(), whole);
+	check(all.stats.frames == whole.size(), "frames counted");
+
+	//the smallest buffer allowed, so it fills up as often as it can
+	StreamDecoder<160> chunked(framing);
+	for (size_t pos = 0; pos < stream.size();) {
+		size_t sizes[] = {1, 8, 64, 512};
+		size_t n = std::min<size_t>(stream.size() - pos, 1 + rng() % sizes[rng() % 4]);
+		//each piece gets its own heap copy, the decoder mustn't hang on to it past the call
+		std::vector<uint8_t> piece(stream.begin() + pos, stream.begin() + pos + n);
+		collect(chunked, piece.data(), n, pieces);
+		pos += n;
+	}
+	check(whole == pieces, "pieces find the same frames as the whole stream");
+	//a COBS frame too big for the buffer is only counted up to where it stopped fitting, so that depends on the size
+	check(framing == FRAMING_COBS || (all.stats.badFrames == chunked.stats.badFrames &&
+			all.stats.skippedBytes == chunked.stats.skippedBytes), "pieces skip the same bytes as the whole stream");
+	return whole;
+}
+
+//compressFrame() from compress.c, on values rather than a frame
+struct DeltaEncoder {
+	uint16_t last[DELTA_MAX_FIELDS];
+	uint8_t lastFlags = 0, lastCount = 0, sequence = 0, sinceKeyframe = 0;
+
+	std::vector<uint8_t> encode(const uint16_t * fields, int count, bool chroma, int keyframeInterval) {
+		uint8_t flags = chroma ? DELTA_CHROMA : 0;
+		std::vector<uint8_t> data;
+		bool keyframe = ++sinceKeyframe >= keyframeInterval || flags != lastFlags || count != lastCount;
+		for (int i = 0; i < count && !keyframe; i++) {
+			int16_t d = fields[i] - last[i];
+			uint16_t z = (uint16_t) ((uint16_t) d << 1) ^ (d < 0 ? 0xffff : 0);
+			while (z >= 0x80) {
+				data.push_back(z | 0x80);
+				z >>= 7;
+			}
+			data.push_back(z);
+			if ((int) data.size() > count * 2)
+				keyframe = true;
+		}
+		if (keyframe) {
+			data.clear();
+			for (int i = 0; i < count; i++) {
+				data.push_back(fields[i] & 0xff);
+				data.push_back(fields[i] >> 8);
+			}
+			sinceKeyframe = 0;
+		}
+		std::vector<uint8_t> frame = {'S', 'D', '1', '.', '0', 0};
+		frame.push_back(flags | (keyframe ? DELTA_KEYFRAME : 0));
+		frame.push_back(count);
+		frame.push_back(sequence++);
+		frame.insert(frame.end(), data.begin(), data.end());
+		frame.insert(frame.end(), {'E', 'N', 'D', 0});
+		memcpy(last, fields, count * 2);
+		lastFlags = flags;
+		lastCount = count;
+		return frame;
+	}
+};
+
+//the input picks how the values move, which frames go missing and how often keyframes come
+static void fuzzDelta(const uint8_t * data, size_t len) {
+	size_t pos = 0;
+	auto next = [&]() -> uint8_t { return pos < len ? data[pos++] : 0; };
+	DeltaEncoder encoder;
+	DeltaDecoder decoder;
+	int keyframeInterval = 1 + next() % 32;
+	uint16_t values[DELTA_MAX_FIELDS] = {};
+	bool chroma = false;
+	bool lost = false; //a frame's gone missing since the last keyframe the decoder saw
+	uint64_t dropped = 0;
+	while (pos < len) {
+		uint8_t op = next();
+		if (op == 0xff)
+			chroma = !chroma;
+		int count = (chroma ? fieldsBytes(FIELD_ALL & ~FIELD_BANDS) : fieldsBytes(FIELD_ALL & ~FIELD_CHROMA)) / 2;
+		//mostly small moves, sometimes a big jump
+		for (int i = 0; i < count; i++) {
+			uint8_t b = next();
+			values[i] += op & 0x80 ? (b << 8 | next()) : (int8_t) b / (1 + (op & 7));
+		}
+		std::vector<uint8_t> frame = encoder.encode(values, count, chroma, keyframeInterval);
+		bool keyframe = frame[6] & DELTA_KEYFRAME;
+		if ((op & 0x60) == 0x60) {
+			lost = true;
+			dropped++;
+			continue;
+		}
+		SensorFrame parsed, decoded;
+		size_t frameLen;
+		check(parseFrame(frame.data(), frame.size(), true, parsed, frameLen) == PARSE_OK && frameLen == frame.size(),
+				"an encoded delta frame parses");
+		if (keyframe)
+			lost = false;
+		bool ok = decoder.decode(parsed, decoded);
+		check(ok == !lost, "delta frames decode unless one went missing since the last keyframe");
+		if (ok) {
+			check((int) decoded.size == count * 2, "decoded size");
+			check(decoded.type == (chroma ? FRAME_CHROMA : FRAME_BANDS), "decoded type");
+			for (int i = 0; i < count; i++)
+				check(readU16(decoded.body + i * 2) == values[i], "delta frames decode to what went in");
+			readAll(decoded);
+		}
+	}
+	check(decoder.gaps <= dropped, "gaps only where frames went missing");
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t * data, size_t len) {
+	fuzzParse(data, len);
+	uint32_t seed = 0;
+	for (size_t i = 0; i < len; i++)
+		seed = seed * 31 + data[i];
+	std::minstd_rand rng(seed | 1);
+	std::vector<uint8_t> stream(data, data + len);
+	std::vector<Found> plain = fuzzStream(FRAMING_PLAIN, stream, rng);
+	//the input as COBS is mostly noise, the frames found in it as COBS have to all come back
+	fuzzStream(FRAMING_COBS, stream, rng);
+	std::vector<uint8_t> encoded;
+	//the 0 at the end of a COBS frame takes the place of "END"
+	for (const Found & f : plain)
+		cobs(encoded, std::vector<uint8_t>(f.bytes.begin(), f.bytes.end() - 4));
+	check(fuzzStream(FRAMING_COBS, encoded, rng) == plain, "frames come back the same through COBS");
+	fuzzDelta(data, len);
+	return 0;
+}
+
+#ifndef SENSOR_FUZZ_LIBFUZZER
+
+static void put16(std::vector<uint8_t> & out, uint16_t v) {
+	out.push_back(v & 0xff);
+	out.push_back(v >> 8);
+}
+
+//one good frame of any type, to start mutating from
+static void addFrame(std::vector<uint8_t> & out, std::mt19937 & rng) {
+	static const char types[] = "BCPMRD";
+	char type = types[rng() % 6];
+	std::vector<uint8_t> frame = {'S', (uint8_t) type, '1', '.', '0', 0};
+	int body;
+	switch (type) {
+	case 'B': body = fieldsBytes(FIELD_ALL & ~FIELD_CHROMA); break;
+	case 'C': body = fieldsBytes(FIELD_ALL & ~FIELD_BANDS); break;
+	case 'P': {
+		uint8_t fields = rng() & (FIELD_ALL & ~FIELD_CHROMA);
+		frame.push_back(fields);
+		body = fieldsBytes(fields);
+		break;
+	}
+	case 'M': body = MOTION_BYTES; break;
+	case 'R': {
+		int n = rng() % (REPLY_MAX_DATA + 1);
+		frame.insert(frame.end(), {(uint8_t) (rng() % 12), 0, (uint8_t) n});
+		body = n;
+		break;
+	}
+	default: {
+		//a non keyframe with small deltas
+		int count = 44;
+		frame.insert(frame.end(), {0, (uint8_t) count, (uint8_t) rng()});
+		for (int i = 0; i < count; i++)
+			frame.push_back(rng() & 0x7f);
+		body = 0;
+	}
+	}
+	for (int i = 0; i < body; i += 2)
+		put16(frame, rng() % 4 ? rng() & 0xff : rng());
+	frame.resize(frame.size() - (body & 1));
+	frame.insert(frame.end(), {'E', 'N', 'D', 0});
+	out.insert(out.end(), frame.begin(), frame.end());
+}
+
+static void mutate(std::vector<uint8_t> & data, std::mt19937 & rng) {
+	int edits = 1 + rng() % 8;
+	for (int e = 0; e < edits; e++) {
+		size_t at = data.empty() ? 0 : rng() % data.size();
+		switch (rng() % 8) {
+		case 0:
+			if (!data.empty())
+				data[at] ^= 1 << (rng() % 8);
+			break;
+		case 1:
+			if (!data.empty())
+				data[at] = rng();
+			break;
+		case 2:
+			data.insert(data.begin() + at, (uint8_t) rng());
+			break;
+		case 3:
+			if (!data.empty())
+				data.erase(data.begin() + at, data.begin() + std::min(data.size(), at + 1 + rng() % 16));
+			break;
+		case 4: {
+			//the bytes that matter most, so they turn up in the wrong places
+			static const uint8_t interesting[] = {0, 'S', 'E', 'N', 'D', '1', '.', 0x80, 0xff, DELTA_MAX_FIELDS + 1};
+			if (!data.empty())
+				data[at] = interesting[rng() % sizeof(interesting)];
+			break;
+		}
+		case 5: {
+			//a copy of some of it somewhere else
+			if (data.empty())
+				break;
+			size_t from = rng() % data.size();
+			size_t n = std::min<size_t>(data.size() - from, 1 + rng() % 200);
+			std::vector<uint8_t> piece(data.begin() + from, data.begin() + from + n);
+			data.insert(data.begin() + at, piece.begin(), piece.end());
+			break;
+		}
+		case 6: {
+			std::vector<uint8_t> frame;
+			addFrame(frame, rng);
+			data.insert(data.begin() + at, frame.begin(), frame.end());
+			break;
+		}
+		default:
+			data.resize(at);
+		}
+	}
+	if (data.size() > 8192)
+		data.resize(8192);
+}
+
+int main(int argc, char ** argv) {
+	long iterations = argc > 1 ? atol(argv[1]) : 100000;
+	std::mt19937 rng(argc > 2 ? atol(argv[2]) : 1);
+	std::vector<uint8_t> start;
+	for (int i = 0; i < 20; i++)
+		addFrame(start, rng);
+	//the good stream itself, then mutations of it
+	LLVMFuzzerTestOneInput(start.data(), start.size());
+	std::vector<uint8_t> data = start;
+	for (long n = 0; n < iterations; n++) {
+		if (rng() % 16 == 0)
+			data = start;
+		mutate(data, rng);
+		LLVMFuzzerTestOneInput(data.data(), data.size());
+		if ((n + 1) % 10000 == 0)
+			fprintf(stderr, "%ld\n", n + 1);
+	}
+	fprintf(stderr, "%ld inputs, all fine\n", iterations);
+	return 0;
+}
+
+#endif
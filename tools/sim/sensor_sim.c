@@ -0,0 +1,273 @@
+//Runs a recording through the firmware on a PC and saves the frames it would send.
+//Handy for tuning bands and settings against real music, for timing the processing,
+//and for seeing how the I2C, command and output handling copes with faults and a slow uart.
+//  gcc -O2 -std=gnu11 -Itools/sim -Iinc -o sensor_sim tools/sim/sensor_sim.c tools/sim/sim_board.c
+//      src/acquire.c src/output.c src/chroma.c src/fix_fft.c src/window.c src/libfixmath_sqrt.c src/settings.c
+//      src/compress.c src/motion.c src/i2c.c src/accelerometer.c src/command.c -lm
+//  ./sensor_sim song.wav frames.bin
+//
+//Build with -DAUDIO_SAMPLE_RATE=... and the other defines in main.h to try them out.
+//Input is a wav file (8, 16, 24 or 32 bit, or float) or with --raw RATE, mono 16 bit little endian samples.
+//It's resampled to AUDIO_SAMPLE_RATE and turned into 12 bit ADC readings, full scale input fills the ADC
+//unless --gain says otherwise. --analog sets what the light sensor and analog inputs read, 0-4095.
+//--payload, --profile, --compress, --framing and --motion set the same settings the commands do.
+//The output is exactly what the board would send, a raw byte stream with no timing. tools/sd_codec.py reads it as is.
+//tools/sensor_capture.cpp only reads its own SBLOG1 logs, sensor_capture record -- frames.log < frames.bin makes one,
+//timed by how fast it was read rather than by the frame rate.
+//The peripherals are simulated in sim_board.c and run on simulated time, so the same run always comes out the same:
+//  --baud N       the uart rate, UART_BAUD to start with. 0 never holds anything up
+//  --input FILE   commands from the host, sent from the start at the baud rate
+//  --nack N       NACK every Nth I2C transaction
+//  --stall N      every Nth I2C transaction never finishes and has to time out
+//  --shake MG     shake the accelerometer side to side 3 times a second, it sits still otherwise
+//Processing takes no time at all in here, so --baud shows whether frames fit, not whether the chip keeps up.
+
+#include "sim_board.h"
+
+#include <math.h>
+#include <time.h>
+
+static uint8_t * readFile(const char * path, long * size) {
+	FILE * f = fopen(path, "rb");
+	if (!f)
+		return NULL;
+	fseek(f, 0, SEEK_END);
+	*size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	uint8_t * data = malloc(*size);
+	if (data && fread(data, 1, *size, f) != (size_t) *size) {
+		free(data);
+		data = NULL;
+	}
+	fclose(f);
+	return data;
+}
+
+static uint32_t le(const uint8_t * p, int bytes) {
+	uint32_t v = 0;
+	for (int i = bytes - 1; i >= 0; i--)
+		v = v << 8 | p[i];
+	return v;
+}
+
+//mixes everything down to mono floats from -1 to 1, returns the sample count or -1 if it can't be read
+static long readWav(const uint8_t * data, long size, float ** samples, int * rate) {
+	if (size < 12 || memcmp(data, "RIFF", 4) || memcmp(data + 8, "WAVE", 4))
+		return -1;
+	int format = 0, channels = 0, bits = 0;
+	for (long pos = 12; pos + 8 <= size;) {
+		long len = le(data + pos + 4, 4);
+		const uint8_t * chunk = data + pos + 8;
+		if (pos + 8 + len > size)
+			len = size - pos - 8; //cut short recordings still have something in them
+		if (!memcmp(data + pos, "fmt ", 4) && len >= 16) {
+			format = le(chunk, 2);
+			channels = le(chunk + 2, 2);
+			*rate = le(chunk + 4, 4);
+			bits = le(chunk + 14, 2);
+			if (format == 0xfffe && len >= 26)
+				format = le(chunk + 24, 2); //extensible, the real format is at the start of the sub format guid
+		} else if (!memcmp(data + pos, "data", 4)) {
+			int bytes = bits / 8;
+			if (!channels || (!(format == 1 && bytes >= 1 && bytes <= 4) && !(format == 3 && bits == 32)))
+				return -1;
+			long count = len / (bytes * channels);
+			float * s = *samples = malloc(count * sizeof(float));
+			for (long i = 0; i < count; i++) {
+				float sum = 0;
+				for (int c = 0; c < channels; c++) {
+					const uint8_t * p = chunk + (i * channels + c) * bytes;
+					uint32_t v = le(p, bytes);
+					if (format == 3) {
+						float f;
+						memcpy(&f, &v, 4);
+						sum += f;
+					} else if (bytes == 1) {
+						sum += (v - 128) / 128.0f; //8 bit is unsigned
+					} else {
+						int32_t sv = (int32_t) (v << (32 - bits));
+						sum += sv / 2147483648.0f;
+					}
+				}
+				s[i] = sum / channels;
+			}
+			return count;
+		}
+		pos += 8 + len + (len & 1);
+	}
+	return -1;
+}
+
+//windowed sinc resampling, low passed a little under whichever nyquist is lower
+//like the anti-aliasing in front of a real ADC, so content above it doesn't fold back into the bands
+#define RESAMPLE_ZEROS 16
+static float * resample(const float * in, long n, int inRate, long * outN) {
+	double step = (double) inRate / AUDIO_SAMPLE_RATE;
+	double scale = step > 1 ? 1 / step : 1;
+	double cutoff = 0.45 * scale; //cycles per input sample
+	int half = (int) ceil(RESAMPLE_ZEROS / scale);
+	*outN = (long) (n / step);
+	float * o = malloc(*outN * sizeof(float));
+	for (long i = 0; i < *outN; i++) {
+		double t = i * step;
+		long center = (long) t;
+		double sum = 0, weights = 0;
+		for (long j = center - half + 1; j <= center + half; j++) {
+			double x = t - j;
+			if (j < 0 || j >= n || fabs(x) >= half)
+				continue;
+			double sinc = x == 0 ? 1 : sin(2 * M_PI * cutoff * x) / (2 * M_PI * cutoff * x);
+			double w = 0.42 + 0.5 * cos(M_PI * x / half) + 0.08 * cos(2 * M_PI * x / half); //blackman
+			sum += in[j] * sinc * w;
+			weights += sinc * w;
+		}
+		o[i] = weights ? sum / weights : 0;
+	}
+	return o;
+}
+
+static double seconds() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void usage() {
+	fprintf(stderr, "usage: sensor_sim [--raw RATE] [--gain G] [--analog 0-4095] [--payload N] [--profile N]\n"
+			"                  [--compress 0|1] [--framing N] [--motion 0|1] [--baud N] [--input commands.bin]\n"
+			"                  [--nack N] [--stall N] [--shake MG] input.wav frames.bin\n");
+	exit(2);
+}
+
+int main(int argc, char ** argv) {
+	int rawRate = 0;
+	double gain = 1;
+	int analog = 2048;
+	const char * inputPath = NULL;
+	const char * paths[2];
+	int pathCount = 0;
+	//every command and saved page is checked against these, so they had better pass
+	if (!settingsValid(&defaultSettings)) {
+		fprintf(stderr, "the built in settings aren't valid with these defines\n");
+		return 2;
+	}
+	settings = defaultSettings;
+	sim.baud = UART_BAUD;
+	for (int i = 1; i < argc; i++) {
+		const char * a = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (!strcmp(a, "--raw") && hasValue)
+			rawRate = atoi(argv[++i]);
+		else if (!strcmp(a, "--gain") && hasValue)
+			gain = atof(argv[++i]);
+		else if (!strcmp(a, "--analog") && hasValue)
+			analog = atoi(argv[++i]);
+		else if (!strcmp(a, "--payload") && hasValue)
+			settings.payload = atoi(argv[++i]);
+		else if (!strcmp(a, "--profile") && hasValue)
+			settings.profile = atoi(argv[++i]);
+		else if (!strcmp(a, "--compress") && hasValue)
+			settings.compress = atoi(argv[++i]);
+		else if (!strcmp(a, "--framing") && hasValue)
+			settings.framing = atoi(argv[++i]);
+		else if (!strcmp(a, "--motion") && hasValue)
+			settings.motion = atoi(argv[++i]);
+		else if (!strcmp(a, "--baud") && hasValue)
+			sim.baud = atol(argv[++i]);
+		else if (!strcmp(a, "--input") && hasValue)
+			inputPath = argv[++i];
+		else if (!strcmp(a, "--nack") && hasValue)
+			sim.nackEvery = atoi(argv[++i]);
+		else if (!strcmp(a, "--stall") && hasValue)
+			sim.stallEvery = atoi(argv[++i]);
+		else if (!strcmp(a, "--shake") && hasValue)
+			sim.shakeMg = atoi(argv[++i]);
+		else if (a[0] != '-' && pathCount < 2)
+			paths[pathCount++] = a;
+		else
+			usage();
+	}
+	if (pathCount != 2 || analog < 0 || analog > 4095)
+		usage();
+	if (!settingsValid(&settings)) {
+		fprintf(stderr, "those settings aren't valid\n");
+		return 2;
+	}
+
+	long size;
+	uint8_t * data = readFile(paths[0], &size);
+	if (!data) {
+		perror(paths[0]);
+		return 1;
+	}
+	float * samples;
+	int rate = 0;
+	long count;
+	if (rawRate) {
+		rate = rawRate;
+		count = size / 2;
+		samples = malloc(count * sizeof(float));
+		for (long i = 0; i < count; i++)
+			samples[i] = (int16_t) le(data + i * 2, 2) / 32768.0f;
+	} else if ((count = readWav(data, size, &samples, &rate)) < 0 || rate <= 0) {
+		fprintf(stderr, "%s: not a wav file this can read\n", paths[0]);
+		return 1;
+	}
+	free(data);
+
+	if (inputPath && !(sim.input = readFile(inputPath, &sim.inputLen))) {
+		perror(inputPath);
+		return 1;
+	}
+	FILE * out = sim.out = fopen(paths[1], "wb");
+	if (!out) {
+		perror(paths[1]);
+		return 1;
+	}
+
+	double start = seconds();
+	long n;
+	float * audio = resample(samples, count, rate, &n);
+	free(samples);
+	//the mic sits at half scale, 12 bits either way
+	uint16_t * adc = malloc(n * sizeof(uint16_t));
+	int clipped = 0;
+	for (long i = 0; i < n; i++) {
+		long v = lround(2048 + audio[i] * gain * 2047);
+		if (v < 0 || v > 4095) {
+			clipped++;
+			v = v < 0 ? 0 : 4095;
+		}
+		adc[i] = v;
+	}
+	free(audio);
+	double prepared = seconds();
+
+	//same as the DMA interrupt and main loop, one sample at a time
+	for (long i = 0; i < n; i++) {
+		simAdvance((uint64_t) i * 1000000 / AUDIO_SAMPLE_RATE);
+		acquireSample(adc[i], analog);
+		commandService();
+		outputService(analogValues);
+		acquireService();
+	}
+	double done = seconds();
+	fclose(out);
+
+	double audioSeconds = (double) n / AUDIO_SAMPLE_RATE;
+	fprintf(stderr, "%.1f seconds of audio at %d Hz, %d samples clipped\n", audioSeconds, AUDIO_SAMPLE_RATE, clipped);
+	fprintf(stderr, "uart: %llu writes, %llu bytes, busy %.0f%% of the time, %llu overruns, %llu changed while sending\n",
+			(unsigned long long) simStats.txWrites, (unsigned long long) simStats.txBytes,
+			simStats.txBusyUs / audioSeconds / 1e4, (unsigned long long) simStats.txOverruns,
+			(unsigned long long) simStats.txChanged);
+	fprintf(stderr, "      %u blocks dropped while the uart was busy, %llu bytes in, %u overruns losing %llu, %u baud changes\n",
+			outputDropped, (unsigned long long) simStats.rxBytes, usartOverruns, (unsigned long long) simStats.rxLost,
+			simStats.baudChanges);
+	fprintf(stderr, "i2c: %u transactions, %u ok, %u errors, %u timeouts, %u NACKed, %u stalled, %u recoveries\n",
+			simStats.i2cTransactions, accelerometerDevice.ok, accelerometerDevice.errors, accelerometerDevice.timeouts,
+			simStats.i2cNacks, simStats.i2cStalls, simStats.i2cRecoveries);
+	fprintf(stderr, "accelerometer: %u samples, %u lost to a full FIFO\n", simStats.accelSamples, simStats.accelOverruns);
+	fprintf(stderr, "resampling %.2fs, firmware %.2fs, %.0fx real time\n", prepared - start, done - prepared,
+			audioSeconds / (done - prepared));
+	return 0;
+}
@@ -0,0 +1,300 @@
+//stands in for the register side of main.c on a PC, so the firmware's sources above it run unchanged
+//time only moves when simAdvance() says so, and everything is worked out from it, so runs are repeatable
+//  ms and SysTick: i2cService() and accelerometerService() are called every simulated ms
+//  uart: bytes are taken out of the buffer one at a time at the baud rate, like the DMA does, so a buffer
+//        that gets rewritten while it's going out shows up garbled, and is counted. the host's bytes
+//        trickle in at the same rate whether they're read or not, into a ring that overruns like the real one
+//  I2C: each step takes a byte time at 400KHz, and the only thing on the bus is a LIS3DH with its FIFO
+//       running in stream mode. transactions can be made to NACK or stall, see SimConfig
+//the ADC isn't in here, the caller hands samples to acquireSample() itself
+
+#include "sim_board.h"
+
+#include <math.h>
+
+#define SIM_CLOCK_HZ 48000000
+#define I2C_BYTE_US 23 //9 clocks at 400KHz
+
+SimConfig sim;
+SimStats simStats;
+
+volatile uint32_t ms;
+static uint64_t nowUs;
+
+uint32_t cycleCount() {
+	return (uint32_t) (nowUs * (SIM_CLOCK_HZ / 1000000));
+}
+
+//microseconds to send a byte, start and stop bits included
+static uint64_t byteUs() {
+	return sim.baud ? (10000000 + sim.baud - 1) / sim.baud : 0;
+}
+
+/*
+ * uart
+ */
+
+static struct {
+	const uint8_t * data;
+	uint8_t copy[256]; //what was in the buffer when it was handed over
+	uint32_t len, pos;
+	uint64_t nextUs; //when the byte at pos is taken, or once they're all gone, when the last one is out
+	bool changed;
+} tx;
+static long rxPos; //the next byte to be read
+static long rxArrived; //bytes landed so far
+static uint64_t rxNextUs; //when the next one lands
+uint16_t usartOverruns;
+
+//send whatever the uart has got to by now, straight from the buffer
+static void txDrain() {
+	while (tx.pos < tx.len && tx.nextUs <= nowUs) {
+		uint8_t c = tx.data[tx.pos];
+		if (c != tx.copy[tx.pos] && !tx.changed) {
+			tx.changed = true;
+			simStats.txChanged++;
+		}
+		fputc(c, sim.out);
+		tx.pos++;
+		tx.nextUs += byteUs();
+		simStats.txBytes++;
+		simStats.txBusyUs += byteUs();
+	}
+}
+
+void writeToUsart(uint8_t * outBuffer, uint32_t len) {
+	//the DMA gets reset, anything left of the last write never goes out
+	if (!usartIdle())
+		simStats.txOverruns++;
+	if (len > sizeof(tx.copy)) {
+		fprintf(stderr, "a %u byte write is more than the simulated uart expects\n", (unsigned) len);
+		exit(1);
+	}
+	tx.data = outBuffer;
+	memcpy(tx.copy, outBuffer, len);
+	tx.len = len;
+	tx.pos = 0;
+	tx.nextUs = nowUs;
+	tx.changed = false;
+	simStats.txWrites++;
+	txDrain();
+}
+
+bool usartIdle() {
+	txDrain();
+	return tx.pos == tx.len && nowUs >= tx.nextUs;
+}
+
+//let in whatever the host has sent by now
+static void rxArrive() {
+	if (!rxArrived && !rxNextUs)
+		rxNextUs = byteUs(); //the first one lands a byte time in
+	while (rxArrived < sim.inputLen && rxNextUs <= nowUs) {
+		rxArrived++;
+		rxNextUs += byteUs();
+	}
+}
+
+bool usartRead(uint8_t * c) {
+	rxArrive();
+	if (rxArrived - rxPos > USART_RX_SIZE) {
+		usartOverruns++;
+		simStats.rxLost += rxArrived - USART_RX_SIZE - rxPos;
+		rxPos = rxArrived - USART_RX_SIZE;
+	}
+	if (rxPos == rxArrived)
+		return false;
+	*c = sim.input[rxPos++];
+	simStats.rxBytes++;
+	return true;
+}
+
+void usartSetBaud(uint32_t baud) {
+	rxArrive(); //what's already on the way came in at the old rate
+	//a uart that's never in the way stays that way
+	if (sim.baud)
+		sim.baud = baud;
+	simStats.baudChanges++;
+}
+
+/*
+ * LIS3DH, just enough of it for accelerometer.c
+ */
+
+static struct {
+	uint8_t regs[128];
+	uint8_t reg; //where the next read or write goes, MSB set to increment
+	int16_t fifo[ACCEL_FIFO_SIZE][3];
+	int head, count;
+	bool overrun;
+	uint64_t next; //the number of the next sample to be taken
+} lis;
+
+static int lisOdrHz() {
+	switch (lis.regs[0x20] >> 4) {
+	case 0b0101: return 100;
+	case 0b0110: return 200;
+	case 0b0111: return 400;
+	case 0b1001: return 1344;
+	default: return 0;
+	}
+}
+
+//fill the FIFO up to now. sitting flat with z up, plus a side to side shake on x
+static void lisUpdate() {
+	int odr = lisOdrHz();
+	uint64_t due = odr ? nowUs * odr / 1000000 : 0;
+	bool streaming = (lis.regs[0x24] & 0x40) && (lis.regs[0x2E] & 0xC0) == 0x80;
+	for (; streaming && lis.next < due; lis.next++) {
+		double t = (double) lis.next / odr;
+		double mg[3] = {sim.shakeMg * sin(2 * M_PI * 3 * t), 0, 1000};
+		int16_t * s = lis.fifo[(lis.head + lis.count) % ACCEL_FIFO_SIZE];
+		for (int axis = 0; axis < 3; axis++)
+			s[axis] = (int16_t) lround(mg[axis] / 12) << 4; //12mg per count at 16g, left justified
+		if (lis.count == ACCEL_FIFO_SIZE) {
+			//stream mode drops the oldest
+			lis.head = (lis.head + 1) % ACCEL_FIFO_SIZE;
+			lis.overrun = true;
+			simStats.accelOverruns++;
+		} else {
+			lis.count++;
+		}
+		simStats.accelSamples++;
+	}
+	lis.next = due;
+}
+
+static void lisWrite(uint8_t value) {
+	int r = lis.reg & 0x7f;
+	lis.regs[r] = value;
+	//bypass mode empties the FIFO
+	if (r == 0x2E && !(value & 0xC0))
+		lis.head = lis.count = lis.overrun = 0;
+	if (lis.reg & 0x80)
+		lis.reg = ((r + 1) & 0x7f) | 0x80;
+}
+
+static uint8_t lisRead() {
+	int r = lis.reg & 0x7f;
+	uint8_t v = lis.regs[r];
+	if (r == 0x2F) {
+		//FIFO_SRC - WTM | OVRN | EMPTY | FSS, FSS only has room for 31
+		v = (lis.overrun ? 0x40 : 0) | (lis.count ? 0 : 0x20) | (lis.count & 0x1f);
+	} else if (r >= 0x28 && r <= 0x2D) {
+		int16_t s = lis.count ? lis.fifo[lis.head][(r - 0x28) / 2] : 0;
+		v = r & 1 ? s >> 8 : s & 0xff;
+		if (r == 0x2D && lis.count) {
+			lis.head = (lis.head + 1) % ACCEL_FIFO_SIZE;
+			lis.count--;
+			lis.overrun = false;
+		}
+	} else if (r == 0x31 || r == 0x39) {
+		v = 0; //INT1_SRC and CLICK_SRC, nothing ever falls or gets tapped
+	}
+	//the FIFO wraps from OUT_Z_H back to OUT_X_L so it can all be read in one go
+	if (lis.reg & 0x80)
+		lis.reg = r == 0x2D ? 0xA8 : ((r + 1) & 0x7f) | 0x80;
+	return v;
+}
+
+/*
+ * I2C, one step at a time, each one an event sent to i2c.c a byte time or so later
+ */
+
+static struct {
+	bool off;
+	bool pending;
+	I2CEvent event;
+	uint64_t eventUs;
+	bool stopAfter; //a read finishing sends RX_DONE, then STOP
+	bool stop; //the write in progress stops at the end, rather than carrying on with a read
+	int sent;
+} bus;
+
+static void busSchedule(I2CEvent event, uint64_t afterUs) {
+	bus.pending = true;
+	bus.event = event;
+	bus.eventUs = nowUs + afterUs;
+}
+
+void i2cBusWrite(uint8_t addr, int len, bool stop) {
+	(void) len;
+	int n = ++simStats.i2cTransactions;
+	bus.pending = false;
+	bus.stop = stop;
+	bus.stopAfter = false;
+	bus.sent = 0;
+	if (sim.stallEvery && n % sim.stallEvery == 0) {
+		simStats.i2cStalls++;
+		return; //nothing ever comes back
+	}
+	if (addr != LIS3DH_ADDR || (sim.nackEvery && n % sim.nackEvery == 0)) {
+		simStats.i2cNacks++;
+		busSchedule(I2C_EVENT_ERROR, I2C_BYTE_US);
+		return;
+	}
+	busSchedule(I2C_EVENT_TX_READY, I2C_BYTE_US);
+}
+
+void i2cBusSend(uint8_t data, bool last) {
+	lisUpdate();
+	if (bus.sent++ == 0)
+		lis.reg = data;
+	else
+		lisWrite(data);
+	busSchedule(!last ? I2C_EVENT_TX_READY : bus.stop ? I2C_EVENT_STOP : I2C_EVENT_TX_DONE, I2C_BYTE_US);
+}
+
+void i2cBusRead(uint8_t addr, void * dest, int len) {
+	(void) addr;
+	lisUpdate();
+	for (int i = 0; i < len; i++)
+		((uint8_t *) dest)[i] = lisRead();
+	bus.stopAfter = true;
+	busSchedule(I2C_EVENT_RX_DONE, (len + 1) * I2C_BYTE_US);
+}
+
+void i2cBusOff() {
+	bus.off = true;
+	bus.pending = false;
+}
+
+void i2cBusRecover() {
+	bus.off = false;
+	simStats.i2cRecoveries++;
+}
+
+static void busDeliver() {
+	I2CEvent event = bus.event;
+	bus.pending = false;
+	if (event == I2C_EVENT_RX_DONE && bus.stopAfter) {
+		bus.stopAfter = false;
+		busSchedule(I2C_EVENT_STOP, 3);
+	}
+	i2cEvent(event);
+}
+
+/*
+ * time
+ */
+
+//move time forward to us, delivering I2C events and running SysTick on the way
+void simAdvance(uint64_t us) {
+	for (;;) {
+		uint64_t tickUs = (uint64_t) (ms + 1) * 1000;
+		if (bus.pending && !bus.off && bus.eventUs <= us && bus.eventUs <= tickUs) {
+			nowUs = bus.eventUs;
+			busDeliver();
+		} else if (tickUs <= us) {
+			nowUs = tickUs;
+			ms++;
+			i2cService();
+			accelerometerService();
+		} else {
+			break;
+		}
+	}
+	nowUs = us;
+	txDrain();
+	rxArrive();
+}
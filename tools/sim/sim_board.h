@@ -0,0 +1,43 @@
+//the peripherals from main.h, simulated so the firmware sources run on a PC, see sim_board.c
+
+#ifndef SIM_BOARD_H
+#define SIM_BOARD_H
+
+#include "main.h"
+
+#include <stdio.h>
+
+//set these up before starting
+typedef struct {
+	FILE * out; //everything the board sends
+	const uint8_t * input; //what the host sends, arriving from the start at the baud rate
+	long inputLen;
+	uint32_t baud; //0 for a uart that never holds anything up
+	int nackEvery; //NACK every nth I2C transaction, 0 for never
+	int stallEvery; //every nth I2C transaction never finishes, so it has to time out
+	int shakeMg; //the accelerometer gets shaken side to side this hard, 0 to sit still
+} SimConfig;
+extern SimConfig sim;
+
+//what happened along the way
+typedef struct {
+	uint64_t txBytes;
+	uint64_t txWrites;
+	uint64_t txOverruns; //writes while the last one was still going out, cutting it short
+	uint64_t txChanged; //writes whose buffer was changed before it was all sent
+	uint64_t txBusyUs;
+	uint64_t rxBytes;
+	uint64_t rxLost; //bytes the ring overran before they were read
+	uint32_t baudChanges;
+	uint32_t i2cTransactions;
+	uint32_t i2cNacks;
+	uint32_t i2cStalls;
+	uint32_t i2cRecoveries;
+	uint32_t accelSamples;
+	uint32_t accelOverruns; //the FIFO filled up between polls
+} SimStats;
+extern SimStats simStats;
+
+void simAdvance(uint64_t us);
+
+#endif
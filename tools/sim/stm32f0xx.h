@@ -0,0 +1,23 @@
+//stands in for the device header when firmware sources are built on a PC by the simulator
+//only what the hardware independent sources need, there are no registers here on purpose
+//so anything that touches the hardware fails to build instead of crashing
+
+#ifndef SIM_STM32F0XX_H
+#define SIM_STM32F0XX_H
+
+#include <stdint.h>
+
+//there's only ever the one thread
+static inline void __disable_irq() {}
+static inline void __enable_irq() {}
+
+//saving settings goes nowhere
+typedef enum {
+	FLASH_BUSY = 1, FLASH_ERROR_WRP, FLASH_ERROR_PROGRAM, FLASH_COMPLETE, FLASH_TIMEOUT
+} FLASH_Status;
+static inline void FLASH_Unlock() {}
+static inline void FLASH_Lock() {}
+static inline FLASH_Status FLASH_ErasePage(uint32_t address) { (void) address; return FLASH_ERROR_PROGRAM; }
+static inline FLASH_Status FLASH_ProgramHalfWord(uint32_t address, uint16_t data) { (void) address; (void) data; return FLASH_ERROR_PROGRAM; }
+
+#endif
@@ -0,0 +1,61 @@
+//Works out the numbers next to the WINDOW_* shapes in main.h, from the lowWindow[] and highWindow[]
+//tables src/window.c compiles to. Build with the shapes to look at:
+//  gcc -O2 -std=gnu11 -Itools/sim -Iinc -DLOW_WINDOW=WINDOW_HANN -DHIGH_WINDOW=WINDOW_HANN
+//      -o window_check tools/window_check.c src/window.c -lm
+//  ./window_check
+//Each table is mirrored the way fftRealWindowedMagnitude() does it, then:
+//  sidelobe     the highest sidelobe, relative to the main lobe
+//  scalloping   how much a tone halfway between two bins loses
+//  coherent     the window's average, what a tone on a bin is scaled by (before the 1/2 applied when windowing)
+//  noise bw     equivalent noise bandwidth in bins, how much broadband noise each bin picks up
+//The response is sampled every 1/16 of a bin, close enough for the sidelobes to a tenth of a dB or so.
+
+#include "main.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define STEPS 16 //response points per bin
+#define NAME(x) #x
+#define SHAPE(x) NAME(x)
+
+static double response(const double * w, int n, double bins) {
+	double re = 0, im = 0;
+	for (int i = 0; i < n; i++) {
+		re += w[i] * cos(2 * M_PI * bins * i / n);
+		im -= w[i] * sin(2 * M_PI * bins * i / n);
+	}
+	return hypot(re, im);
+}
+
+static void measure(const char * shape, const int16_t * table, int n) {
+	double w[HIGH_N];
+	double sum = 0, squares = 0;
+	for (int i = 0; i < n; i++) {
+		w[i] = table[i <= n / 2 ? i : n - i];
+		sum += w[i];
+		squares += w[i] * w[i];
+	}
+	double peak = response(w, n, 0);
+	int points = n / 2 * STEPS + 1;
+	double * db = malloc(points * sizeof(double));
+	for (int s = 0; s < points; s++)
+		db[s] = 20 * log10(fmax(response(w, n, (double) s / STEPS), 1e-9) / peak);
+	//the main lobe runs out to the first dip
+	int edge = 1;
+	while (edge < points - 1 && !(db[edge] <= db[edge - 1] && db[edge] <= db[edge + 1]))
+		edge++;
+	double sidelobe = -INFINITY;
+	for (int s = edge; s < points; s++)
+		sidelobe = fmax(sidelobe, db[s]);
+	free(db);
+	printf("%-24s %4d points: %6.1fdB sidelobe, %6.2fdB scalloping, %.2f coherent gain, %.2f bin noise bandwidth\n",
+			shape, n, sidelobe, 20 * log10(response(w, n, 0.5) / peak), sum / n / 32767, n * squares / (sum * sum));
+}
+
+int main() {
+	measure(SHAPE(LOW_WINDOW), lowWindow, LOW_N);
+	measure(SHAPE(HIGH_WINDOW), highWindow, HIGH_N);
+	return 0;
+}